@@ -0,0 +1,148 @@
+#include "arena.h"
+#include <algorithm>
+
+// Свободные блоки одной арены, закрепленные за потоком
+struct SlabArena::ThreadCache {
+    std::shared_ptr<Pool> pool;
+    FreeBlock* free[class_count] = {};
+    size_t count[class_count] = {};
+
+    // Возвращает все блоки в общие списки (если арена еще жива)
+    void flush() {
+        for (size_t i = 0; i < class_count; i++) {
+            if (!free[i]) continue;
+            FreeBlock* last = free[i];
+            while (last->next) last = last->next;
+            pool->give(i, free[i], last);
+            free[i] = nullptr;
+            count[i] = 0;
+        }
+    }
+};
+
+// Кэши потока для всех арен, из которых он выделял или освобождал память.
+// При завершении потока блоки возвращаются аренам
+struct SlabArena::ThreadCaches {
+    std::vector<std::unique_ptr<ThreadCache>> caches;
+
+    ~ThreadCaches() {
+        for (auto& cache : caches) {
+            if (cache->pool->alive.load(std::memory_order_acquire)) cache->flush();
+        }
+    }
+};
+
+SlabArena::SlabArena() : pool(std::make_shared<Pool>()) {}
+
+SlabArena::~SlabArena() {
+    // Кэши других потоков отпустят общую часть, когда заметят это
+    pool->alive.store(false, std::memory_order_release);
+}
+
+size_t SlabArena::class_index(size_t size) {
+    if (size <= fine_limit) return size == 0 ? 0 : (size - 1) / class_step;
+    size_t index = fine_limit / class_step;
+    size_t block = fine_limit * 2;
+    while (block < size) {
+        block <<= 1;
+        index++;
+    }
+    return index;
+}
+
+size_t SlabArena::class_size(size_t index) {
+    size_t fine = fine_limit / class_step;
+    if (index < fine) return (index + 1) * class_step;
+    return fine_limit << (index - fine + 1);
+}
+
+size_t SlabArena::Pool::take(size_t index, FreeBlock*& list) {
+    SizeClass& sc = classes[index];
+    size_t block = class_size(index);
+    size_t taken = 0;
+
+    std::lock_guard<std::mutex> lock(sc.mtx);
+    while (sc.free && taken < cache_batch) {
+        FreeBlock* b = sc.free;
+        sc.free = b->next;
+        b->next = list;
+        list = b;
+        taken++;
+    }
+    if (taken > 0) return taken;
+
+    if ((size_t)(sc.end - sc.cursor) < block) {
+        sc.slabs.emplace_back(new char[slab_size]);
+        sc.cursor = sc.slabs.back().get();
+        sc.end = sc.cursor + slab_size;
+        reserved.fetch_add(slab_size, std::memory_order_relaxed);
+    }
+    // Хвост слэба короче блока (slab_size не кратен, например, 48) не используется
+    while ((size_t)(sc.end - sc.cursor) >= block && taken < cache_batch) {
+        FreeBlock* b = reinterpret_cast<FreeBlock*>(sc.cursor);
+        sc.cursor += block;
+        b->next = list;
+        list = b;
+        taken++;
+    }
+    return taken;
+}
+
+void SlabArena::Pool::give(size_t index, FreeBlock* first, FreeBlock* last) {
+    SizeClass& sc = classes[index];
+    std::lock_guard<std::mutex> lock(sc.mtx);
+    last->next = sc.free;
+    sc.free = first;
+}
+
+SlabArena::ThreadCache& SlabArena::local_cache() {
+    thread_local ThreadCaches local;
+    for (auto& cache : local.caches) {
+        if (cache->pool == pool) return *cache;
+    }
+    // Кэши уничтоженных арен больше не нужны: их блоки уходят вместе с общей частью
+    auto& caches = local.caches;
+    caches.erase(std::remove_if(caches.begin(), caches.end(), [](const std::unique_ptr<ThreadCache>& cache) {
+        return !cache->pool->alive.load(std::memory_order_acquire);
+        }), caches.end());
+    caches.push_back(std::make_unique<ThreadCache>());
+    caches.back()->pool = pool;
+    return *caches.back();
+}
+
+void* SlabArena::allocate(size_t size) {
+    if (size > max_block) return ::operator new(size);
+
+    size_t index = class_index(size);
+    ThreadCache& cache = local_cache();
+    if (!cache.free[index]) cache.count[index] = pool->take(index, cache.free[index]);
+
+    FreeBlock* b = cache.free[index];
+    cache.free[index] = b->next;
+    cache.count[index]--;
+    return b;
+}
+
+void SlabArena::deallocate(void* p, size_t size) {
+    if (!p) return;
+    if (size > max_block) {
+        ::operator delete(p);
+        return;
+    }
+
+    size_t index = class_index(size);
+    ThreadCache& cache = local_cache();
+    FreeBlock* b = static_cast<FreeBlock*>(p);
+    b->next = cache.free[index];
+    cache.free[index] = b;
+
+    // Лишнее отдается пачкой: поток, который только освобождает, не копит блоки
+    if (++cache.count[index] >= 2 * cache_batch) {
+        FreeBlock* first = cache.free[index];
+        FreeBlock* last = first;
+        for (size_t i = 1; i < cache_batch; i++) last = last->next;
+        cache.free[index] = last->next;
+        cache.count[index] -= cache_batch;
+        pool->give(index, first, last);
+    }
+}
\ No newline at end of file
@@ -0,0 +1,102 @@
+#pragma once
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <mutex>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <cstddef>
+
+// Пул памяти для множества мелких объектов (записей задач). Память берется
+// у системы крупными слэбами и нарезается на блоки фиксированных размеров
+// (классы через 16 байт до 512, затем 1024, 2048 и 4096): на блок уходит
+// не больше 15 байт сверх запрошенного у мелких объектов, из которых и
+// состоит почти вся память задач. Освобожденный блок уходит в список
+// свободных своего класса и переиспользуется без обращения к malloc.
+// Блоки крупнее 4096 байт выделяются обычным operator new.
+// У каждого потока свой кэш свободных блоков: выделение и освобождение
+// обычно не берут блокировок, и записи в разные шарды не встают в очередь
+// за одним мьютексом. Общие списки класса блокируются только при обмене
+// пачкой блоков с кэшем потока и при нарезке нового слэба.
+// Слэбы возвращаются системе после уничтожения арены, когда ее отпустят и
+// кэши потоков. Арена должна жить дольше всех выделенных из нее объектов.
+class SlabArena {
+public:
+    SlabArena();
+    ~SlabArena();
+    SlabArena(const SlabArena&) = delete;
+    SlabArena& operator=(const SlabArena&) = delete;
+
+    void* allocate(size_t size);
+    void deallocate(void* p, size_t size);
+
+    // Сколько памяти получено у системы под слэбы
+    size_t reserved_bytes() const { return pool->reserved.load(std::memory_order_relaxed); }
+
+    static const size_t max_block = 4096;
+
+private:
+    static const size_t class_step = 16;
+    static const size_t fine_limit = 512;  // до него классы идут с шагом class_step
+    static const size_t class_count = fine_limit / class_step + 3;  // 16 .. 512, 1024, 2048, 4096
+    static const size_t slab_size = 256 * 1024;
+    static const size_t cache_batch = 32;  // блоков за один обмен кэша потока с общим списком
+
+    struct FreeBlock {
+        FreeBlock* next;
+    };
+
+    struct alignas(64) SizeClass {
+        std::mutex mtx;
+        FreeBlock* free = nullptr;
+        char* cursor = nullptr;  // еще не нарезанная часть текущего слэба
+        char* end = nullptr;
+        std::vector<std::unique_ptr<char[]>> slabs;
+    };
+
+    // Общая часть арены. Кэши потоков держат ссылку на нее: блоки в кэше
+    // потока, пережившего арену, указывают в ее слэбы
+    struct Pool {
+        SizeClass classes[class_count];
+        std::atomic<size_t> reserved{ 0 };
+        std::atomic<bool> alive{ true };
+
+        // Отдает в list до cache_batch блоков класса index
+        size_t take(size_t index, FreeBlock*& list);
+        // Возвращает цепочку блоков от first до last
+        void give(size_t index, FreeBlock* first, FreeBlock* last);
+    };
+
+    struct ThreadCache;
+    struct ThreadCaches;
+
+    static size_t class_index(size_t size);
+    static size_t class_size(size_t index);
+    ThreadCache& local_cache();
+
+    std::shared_ptr<Pool> pool;
+};
+
+// Аллокатор для std::allocate_shared / shared_ptr поверх SlabArena
+template <typename T>
+class ArenaAllocator {
+public:
+    using value_type = T;
+
+    explicit ArenaAllocator(SlabArena* arena) : arena(arena) {}
+    template <typename U>
+    ArenaAllocator(const ArenaAllocator<U>& other) : arena(other.arena) {}
+
+    T* allocate(size_t n) { return static_cast<T*>(arena->allocate(n * sizeof(T))); }
+    void deallocate(T* p, size_t n) { arena->deallocate(p, n * sizeof(T)); }
+
+    template <typename U>
+    bool operator==(const ArenaAllocator<U>& other) const { return arena == other.arena; }
+    template <typename U>
+    bool operator!=(const ArenaAllocator<U>& other) const { return arena != other.arena; }
+
+    SlabArena* arena;
+};
+
+#endif
\ No newline at end of file
@@ -0,0 +1,428 @@
+﻿// Микробенчмарки сериализации, TaskManager, MessageQueue и маршрутизации,
+// а также весь путь запроса через обработчики API без сокетов (pipeline/*).
+// Запуск: bench [фильтр] [--max-tasks N]
+//   фильтр      - выполняются только замеры, в имени которых есть эта подстрока
+//   --max-tasks - пропускать замеры TaskManager на большем числе задач
+//                 (по умолчанию 10000000, около нескольких ГБ памяти)
+// Цифры имеют смысл только в оптимизированной сборке (-DCMAKE_BUILD_TYPE=Release)
+#include "handler.h"
+#include "queue.h"
+#include "task.h"
+#include "logger.h"
+#include "routes.h"
+#include "httplib.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+    using Clock = std::chrono::steady_clock;
+
+    struct Options {
+        std::string filter;
+        size_t max_tasks = 10000000;
+    };
+
+    Options options;
+
+    // Результаты складываются сюда, чтобы компилятор не выбросил измеряемый код
+    volatile size_t sink = 0;
+
+    bool selected(const std::string& name) {
+        return options.filter.empty() || name.find(options.filter) != std::string::npos;
+    }
+
+    void report(const std::string& name, size_t ops, Clock::duration elapsed) {
+        double ns = std::chrono::duration<double, std::nano>(elapsed).count();
+        std::printf("%-36s %12zu ops %12.1f ns/op %14.0f ops/s\n",
+            name.c_str(), ops, ns / ops, ops * 1e9 / ns);
+        std::fflush(stdout);
+    }
+
+    // Выполняет fn(n) с растущим n, пока один прогон не займет полсекунды
+    template <typename Fn>
+    void run(const std::string& name, Fn fn) {
+        if (!selected(name)) return;
+        size_t iterations = 1;
+        for (;;) {
+            auto start = Clock::now();
+            fn(iterations);
+            auto elapsed = Clock::now() - start;
+            double seconds = std::chrono::duration<double>(elapsed).count();
+            if (seconds >= 0.5 || iterations >= (size_t(1) << 32)) {
+                report(name, iterations, elapsed);
+                return;
+            }
+            size_t estimate = seconds > 0 ? (size_t)(iterations * 0.6 / seconds) : iterations * 100;
+            iterations = std::min(std::max(estimate, iterations * 2), iterations * 100);
+        }
+    }
+
+    // Однократный замер операции, которую нельзя повторять (заполнение, удаление)
+    template <typename Fn>
+    void run_once(const std::string& name, size_t ops, Fn fn) {
+        if (!selected(name)) return;
+        auto start = Clock::now();
+        fn();
+        report(name, ops, Clock::now() - start);
+    }
+
+    // threads потоков одновременно выполняют fn(thread_index, n)
+    template <typename Fn>
+    void run_threads(const std::string& name, size_t threads, Fn fn) {
+        run(name, [&](size_t n) {
+            size_t per_thread = std::max<size_t>(1, n / threads);
+            std::vector<std::thread> workers;
+            for (size_t t = 0; t < threads; t++) {
+                workers.emplace_back([&fn, t, per_thread]() { fn(t, per_thread); });
+            }
+            for (auto& w : workers) w.join();
+        });
+    }
+
+    std::string size_label(size_t n) {
+        if (n >= 1000000) return std::to_string(n / 1000000) + "M";
+        if (n >= 1000) return std::to_string(n / 1000) + "K";
+        return std::to_string(n);
+    }
+
+    Task sample_task(int id) {
+        Task task;
+        task.id = id;
+        task.title = "Подготовить отчет #" + std::to_string(id);
+        task.description = "Собрать данные за квартал, проверить \"итоги\" и отправить";
+        task.status = TaskStatus::IN_PROGRESS;
+        return task;
+    }
+
+    void bench_task() {
+        const Task task = sample_task(42);
+        const std::string json = task.to_json();
+
+        run("task/from_json", [&](size_t n) {
+            for (size_t i = 0; i < n; i++) sink += Task::from_json(json).title.size();
+        });
+        run("task/to_json", [&](size_t n) {
+            for (size_t i = 0; i < n; i++) sink += task.to_json().size();
+        });
+        run("task/append_json", [&](size_t n) {
+            std::string out;
+            for (size_t i = 0; i < n; i++) {
+                out.clear();
+                task.append_json(out);
+                sink += out.size();
+            }
+        });
+    }
+
+    const char* const manager_benches[] = {
+        "create", "find", "find/8threads", "patch", "patch/8threads",
+        "snapshot/after_write", "snapshot/cached", "snapshot/iterate", "delete",
+    };
+
+    void bench_manager(size_t count) {
+        std::string prefix = "manager/" + size_label(count) + "/";
+        // Заполнение дорогое: без подходящих под фильтр замеров не начинаем
+        bool any = false;
+        for (const char* name : manager_benches) any = any || selected(prefix + name);
+        if (!any) return;
+
+        MessageQueue queue;
+        queue.start();
+        TaskManager manager(queue);
+
+        // Заполнение выполняется всегда: на нем держатся остальные замеры
+        {
+            auto start = Clock::now();
+            for (size_t i = 1; i <= count; i++) manager.create_task(sample_task(0));
+            if (selected(prefix + "create")) report(prefix + "create", count, Clock::now() - start);
+        }
+
+        std::mt19937 rng(12345);
+        std::uniform_int_distribution<int> any_id(1, (int)count);
+
+        run(prefix + "find", [&](size_t n) {
+            for (size_t i = 0; i < n; i++) sink += manager.find_task(any_id(rng))->json().size();
+        });
+        run_threads(prefix + "find/8threads", 8, [&](size_t t, size_t n) {
+            std::mt19937 local(t);
+            std::uniform_int_distribution<int> ids(1, (int)count);
+            for (size_t i = 0; i < n; i++) sink += manager.find_task(ids(local))->id;
+        });
+
+        static const TaskStatus statuses[] = { TaskStatus::TODO, TaskStatus::IN_PROGRESS, TaskStatus::DONE };
+        run(prefix + "patch", [&](size_t n) {
+            for (size_t i = 0; i < n; i++) sink += manager.patch_task(any_id(rng), statuses[i % 3])->id;
+        });
+        run_threads(prefix + "patch/8threads", 8, [&](size_t t, size_t n) {
+            std::mt19937 local(t);
+            std::uniform_int_distribution<int> ids(1, (int)count);
+            for (size_t i = 0; i < n; i++) sink += manager.patch_task(ids(local), statuses[i % 3])->id;
+        });
+
+        // Снимок после записи пересобирает затронутые шарды, без записи - берется готовый
+        run(prefix + "snapshot/after_write", [&](size_t n) {
+            for (size_t i = 0; i < n; i++) {
+                manager.patch_task(any_id(rng), statuses[i % 3]);
+                sink += manager.get_all_tasks().size();
+            }
+        });
+        run(prefix + "snapshot/cached", [&](size_t n) {
+            for (size_t i = 0; i < n; i++) sink += manager.get_all_tasks().size();
+        });
+        run(prefix + "snapshot/iterate", [&](size_t n) {
+            for (size_t i = 0; i < n; i++) {
+                manager.get_all_tasks().for_each([](const TaskRecord& task) {
+                    sink += task.id;
+                    return true;
+                    });
+            }
+        });
+
+        run_once(prefix + "delete", count, [&]() {
+            for (size_t i = 1; i <= count; i++) manager.delete_task((int)i);
+        });
+        queue.stop();
+    }
+
+    // producers потоков кладут пустые задачи в очередь с workers обработчиками
+    void bench_queue(size_t producers, size_t workers) {
+        std::string name = "queue/" + std::to_string(producers) + "p" + std::to_string(workers) + "w";
+        run(name, [&](size_t n) {
+            MessageQueue queue(4096, OverflowPolicy::Block, workers);
+            queue.start();
+            std::atomic<size_t> processed{ 0 };
+            size_t per_thread = std::max<size_t>(1, n / producers);
+            std::vector<std::thread> threads;
+            for (size_t p = 0; p < producers; p++) {
+                threads.emplace_back([&]() {
+                    for (size_t i = 0; i < per_thread; i++) {
+                        queue.push([&processed]() { processed.fetch_add(1, std::memory_order_relaxed); });
+                    }
+                });
+            }
+            for (auto& t : threads) t.join();
+            queue.stop(true);
+            sink += processed.load();
+        });
+    }
+
+    // Разбор запроса и выбор обработчика - то, что сервер делает до вызова обработчика
+    void bench_routing() {
+        using httplib::detail::Method;
+        httplib::detail::Router router;
+        httplib::Handler noop = [](const httplib::Request&, httplib::Response&) {};
+        router.add(Method::Get, "/", noop, 1);
+        router.add(Method::Get, "/tasks", noop, 2);
+        router.add(Method::Get, "/tasks/stats", noop, 3);
+        router.add(Method::Post, "/tasks", noop, 4);
+        router.add(Method::Post, "/tasks:batch", noop, 5);
+        router.add(Method::Patch, "/tasks:batch", noop, 6);
+        router.add(Method::Get, "/tasks/{id:int}", noop, 7);
+        router.add(Method::Put, "/tasks/{id:int}", noop, 8);
+        router.add(Method::Patch, "/tasks/{id:int}", noop, 9);
+        router.add(Method::Delete, "/tasks/{id:int}", noop, 10);
+
+        httplib::detail::RequestArena arena;
+        auto bench_match = [&](const std::string& name, Method method, std::string_view target) {
+            run(name, [&](size_t n) {
+                for (size_t i = 0; i < n; i++) {
+                    arena.release();
+                    httplib::Request req(arena.resource());
+                    req.target = target;
+                    req.path = target.substr(0, target.find('?'));
+                    httplib::detail::parse_query(req);
+                    size_t route_id;
+                    sink += router.match(method, req, route_id) != nullptr;
+                }
+            });
+        };
+        bench_match("route/static", Method::Get, "/tasks/stats");
+        bench_match("route/param", Method::Get, "/tasks/123456");
+        bench_match("route/query", Method::Get, "/tasks?status=done&limit=50&cursor=1000");
+        bench_match("route/miss", Method::Get, "/projects/1/tasks");
+
+        std::string raw =
+            "PATCH /tasks/123 HTTP/1.1\r\n"
+            "Host: localhost:8080\r\n"
+            "User-Agent: bench\r\n"
+            "Accept: application/json\r\n"
+            "Content-Type: application/json\r\n"
+            "Content-Length: 20\r\n"
+            "\r\n"
+            "{\"status\":\"done\"}   ";
+        // Запись одного запроса в метрики сервера - на каждом запросе
+        httplib::detail::ServerMetrics metrics;
+        metrics.set_route_count(11);
+        run("metrics/record", [&](size_t n) {
+            for (size_t i = 0; i < n; i++) {
+                metrics.record(i % 11, 200, std::chrono::microseconds(50 + i % 1000));
+            }
+        });
+
+        run("http/parse_request", [&](size_t n) {
+            httplib::detail::RequestParser parser;
+            for (size_t i = 0; i < n; i++) {
+                arena.release();
+                parser.reset();
+                httplib::Request req(arena.resource());
+                if (parser.parse(raw) == httplib::detail::RequestParser::Result::Complete) parser.fill(raw, req);
+                sink += req.headers.size();
+            }
+        });
+    }
+
+    // Забирает из сессии готовые ответы, как это сделал бы цикл отправки;
+    // незавершенный потоковый ответ дочитывается до конца
+    size_t drain(httplib::detail::Session& session) {
+        size_t bytes = 0;
+        for (;;) {
+            std::string_view parts[16];
+            int count;
+            while ((count = session.out.peek(parts, 16)) > 0) {
+                size_t n = 0;
+                for (int i = 0; i < count; i++) n += parts[i].size();
+                session.out.consume(n);
+                bytes += n;
+            }
+            if (!session.stream) return bytes;
+            if (session.stream(session.out) != httplib::detail::StreamResult::Continue) {
+                session.stream = nullptr;
+            }
+        }
+    }
+
+    const char* const pipeline_benches[] = {
+        "get_id", "get_id/x16", "get_id/8threads", "list/limit50", "stats",
+        "post", "patch", "patch/8threads", "dispatch/get_id", "dispatch/patch",
+    };
+
+    // Запрос проходит разбор HTTP, маршрутизацию, обработчик из routes.cpp,
+    // TaskManager и сериализацию ответа - все, кроме чтения и записи сокета
+    void bench_pipeline() {
+        const size_t count = 10000;
+        bool any = false;
+        for (const char* name : pipeline_benches) any = any || selected(std::string("pipeline/") + name);
+        if (!any) return;
+
+        MessageQueue queue;
+        queue.start();
+        TaskManager manager(queue);
+        // Записи отбрасываются сразу, без обращения к буферу
+        Logger logger;
+        logger.set_level(LogLevel::Error);
+        httplib::Server svr;
+        register_routes(svr, manager, logger, queue);
+        for (size_t i = 1; i <= count; i++) manager.create_task(sample_task(0));
+
+        auto request = [](const std::string& method, const std::string& target, const std::string& body = {}) {
+            std::string raw = method + " " + target + " HTTP/1.1\r\n"
+                "Host: localhost:8080\r\n"
+                "User-Agent: bench\r\n"
+                "Accept: application/json\r\n";
+            if (!body.empty()) {
+                raw += "Content-Type: application/json\r\nContent-Length: " + std::to_string(body.size()) + "\r\n";
+            }
+            return raw + "\r\n" + body;
+        };
+        // Запросы по кругу через одно keep-alive соединение, batch запросов за раз
+        auto bench_raw = [&](const std::string& name, const std::vector<std::string>& raws, size_t batch) {
+            run("pipeline/" + name, [&](size_t n) {
+                httplib::detail::Session session;
+                for (size_t i = 0; i < n; i += batch) {
+                    for (size_t b = 0; b < batch; b++) session.in += raws[(i + b) % raws.size()];
+                    svr.process_session(session);
+                    sink += drain(session);
+                }
+            });
+        };
+
+        std::mt19937 rng(12345);
+        std::uniform_int_distribution<int> any_id(1, (int)count);
+        std::vector<std::string> gets, patches;
+        static const char* const statuses[] = { "todo", "in_progress", "done" };
+        for (size_t i = 0; i < 1024; i++) {
+            std::string target = "/tasks/" + std::to_string(any_id(rng));
+            gets.push_back(request("GET", target));
+            patches.push_back(request("PATCH", target, std::string("{\"status\":\"") + statuses[i % 3] + "\"}"));
+        }
+
+        bench_raw("get_id", gets, 1);
+        bench_raw("get_id/x16", gets, 16);
+        bench_raw("list/limit50", { request("GET", "/tasks?limit=50&cursor=5000") }, 1);
+        bench_raw("stats", { request("GET", "/tasks/stats") }, 1);
+        bench_raw("post", { request("POST", "/tasks",
+            "{\"title\":\"Подготовить отчет\",\"description\":\"Собрать данные за квартал\"}") }, 1);
+        bench_raw("patch", patches, 1);
+
+        auto bench_raw_threads = [&](const std::string& name, const std::vector<std::string>& raws) {
+            run_threads("pipeline/" + name, 8, [&](size_t t, size_t n) {
+                httplib::detail::Session session;
+                for (size_t i = 0; i < n; i++) {
+                    session.in += raws[(i + t * 128) % raws.size()];
+                    svr.process_session(session);
+                    sink += drain(session);
+                }
+            });
+        };
+        bench_raw_threads("get_id/8threads", gets);
+        bench_raw_threads("patch/8threads", patches);
+
+        // Синтетический запрос в обход разбора HTTP
+        httplib::detail::RequestArena arena;
+        auto bench_dispatch = [&](const std::string& name, std::string_view method, std::string_view body) {
+            std::vector<std::string> targets;
+            for (size_t i = 0; i < 1024; i++) targets.push_back("/tasks/" + std::to_string(any_id(rng)));
+            run("pipeline/" + name, [&](size_t n) {
+                for (size_t i = 0; i < n; i++) {
+                    arena.release();
+                    httplib::Request req(arena.resource());
+                    httplib::Response res(arena.resource());
+                    req.method = method;
+                    req.version = "HTTP/1.1";
+                    req.target = req.path = targets[i % targets.size()];
+                    req.body = body;
+                    svr.dispatch(req, res);
+                    sink += res.status;
+                }
+            });
+        };
+        bench_dispatch("dispatch/get_id", "GET", {});
+        bench_dispatch("dispatch/patch", "PATCH", "{\"status\":\"done\"}");
+
+        queue.stop();
+    }
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    for (int i = 1; i < argc; i++) {
+        if (std::strcmp(argv[i], "--max-tasks") == 0 && i + 1 < argc) {
+            options.max_tasks = std::strtoull(argv[++i], nullptr, 10);
+        }
+        else if (argv[i][0] == '-') {
+            std::fprintf(stderr, "Использование: %s [фильтр] [--max-tasks N]\n", argv[0]);
+            return 1;
+        }
+        else {
+            options.filter = argv[i];
+        }
+    }
+
+    bench_task();
+    bench_routing();
+    bench_pipeline();
+    for (auto [producers, workers] : { std::pair<size_t, size_t>{ 1, 1 }, { 4, 1 }, { 4, 4 }, { 8, 4 } }) {
+        bench_queue(producers, workers);
+    }
+    for (size_t count : { size_t(1000), size_t(1000000), size_t(10000000) }) {
+        if (count <= options.max_tasks) bench_manager(count);
+    }
+    return 0;
+}
\ No newline at end of file
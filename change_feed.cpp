@@ -0,0 +1,152 @@
+#include "change_feed.h"
+#include "handler.h"
+#include "json_codec.h"
+#include <chrono>
+#include <thread>
+
+namespace {
+
+    template <typename String>
+    void append_event_json(String& out, const ChangeEvent& event) {
+        out += "{\"seq\":";
+        json_append_int(out, (long long)event.seq);
+        out += ",\"type\":\"";
+        out += ChangeEvent::type_name(event.type);
+        if (event.type == ChangeType::Deleted || !event.task) {
+            out += "\",\"id\":";
+            json_append_int(out, event.id);
+        }
+        else {
+            out += "\",\"task\":";
+            std::string_view json = event.task->json();
+            out.append(json.data(), json.size());
+        }
+        out += '}';
+    }
+
+} // namespace
+
+const char* ChangeEvent::type_name(ChangeType type) {
+    switch (type) {
+    case ChangeType::Created: return "created";
+    case ChangeType::Updated: return "updated";
+    case ChangeType::Deleted: return "deleted";
+    }
+    return "updated";
+}
+
+void ChangeEvent::append_json(std::string& out) const {
+    append_event_json(out, *this);
+}
+
+void ChangeEvent::append_json(std::pmr::string& out) const {
+    append_event_json(out, *this);
+}
+
+void ChangeFeed::Slot::lock() {
+    while (busy.exchange(true, std::memory_order_acquire)) {
+        while (busy.load(std::memory_order_relaxed)) std::this_thread::yield();
+    }
+}
+
+ChangeFeed::ChangeFeed(MessageQueue& mq, size_t capacity)
+    : ring(std::make_unique<Slot[]>(capacity)), capacity(capacity), message_queue(mq) {
+    auto now = std::chrono::system_clock::now().time_since_epoch();
+    first_seq = (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(now).count();
+    next_seq.store(first_seq);
+    published.store(first_seq - 1);
+}
+
+void ChangeFeed::append(ChangeType type, int id, std::shared_ptr<const TaskRecord> task) {
+    uint64_t seq = next_seq.fetch_add(1, std::memory_order_relaxed);
+    Slot& slot = ring[seq % capacity];
+    slot.lock();
+    // Ячейку мог занять писатель, обогнавший этого на целое кольцо
+    if (slot.seq.load(std::memory_order_relaxed) < seq) {
+        slot.type = type;
+        slot.id = id;
+        // Вытесненная версия освобождается после снятия замка
+        task.swap(slot.task);
+        slot.seq.store(seq, std::memory_order_seq_cst);
+    }
+    slot.unlock();
+    task.reset();
+    publish(seq);
+
+    if (subscribers_size.load(std::memory_order_relaxed) == 0) return;
+    if (notify_pending.exchange(true, std::memory_order_acq_rel)) return;
+    if (!message_queue.push([this]() { notify(); })) {
+        notify_pending.store(false, std::memory_order_release);
+    }
+}
+
+// Писатели заканчивают не по порядку номеров. Граница сдвигается тем, кто
+// дописал событие сразу за ней, и он же подхватывает уже дописанные следующие.
+// Запись номера в ячейку и сдвиг границы - seq_cst: писатель, опоздавший со
+// сдвигом, и писатель, проверяющий следующую ячейку, не разминутся.
+// Ячейка с большим номером значит, что событие уже вытеснено, а его писатель
+// мог уже отступиться от сдвига: граница проходит такое событие сама
+void ChangeFeed::publish(uint64_t seq) {
+    uint64_t expected = seq - 1;
+    while (published.compare_exchange_strong(expected, seq, std::memory_order_seq_cst)) {
+        seq++;
+        if (ring[seq % capacity].seq.load(std::memory_order_seq_cst) < seq) return;
+        expected = seq - 1;
+    }
+}
+
+void ChangeFeed::discard() {
+    for (size_t i = 0; i < capacity; i++) ring[i].task.reset();
+    first_seq = next_seq.load();
+}
+
+uint64_t ChangeFeed::last_seq() const {
+    return published.load(std::memory_order_acquire);
+}
+
+ChangeFeed::ReadResult ChangeFeed::read(uint64_t since, size_t max, std::vector<ChangeEvent>& out) const {
+    uint64_t last = published.load(std::memory_order_acquire);
+    if (since > last) return ReadResult::Invalid;
+    if (since + 1 < first_seq) return ReadResult::Expired;
+    size_t read = 0;
+    for (uint64_t seq = since + 1; seq <= last && read < max; seq++, read++) {
+        Slot& slot = ring[seq % capacity];
+        slot.lock();
+        if (slot.seq.load(std::memory_order_relaxed) != seq) {
+            // Событие уже вытеснено более новым
+            slot.unlock();
+            return read == 0 ? ReadResult::Expired : ReadResult::Ok;
+        }
+        out.push_back(ChangeEvent{ seq, slot.type, slot.id, slot.task });
+        slot.unlock();
+    }
+    return ReadResult::Ok;
+}
+
+uint64_t ChangeFeed::subscribe(Waker waker) {
+    std::lock_guard<std::mutex> lock(subscribers_mtx);
+    uint64_t subscription = next_subscription++;
+    subscribers.emplace(subscription, std::move(waker));
+    subscribers_size.store(subscribers.size(), std::memory_order_relaxed);
+    return subscription;
+}
+
+void ChangeFeed::unsubscribe(uint64_t subscription) {
+    std::lock_guard<std::mutex> lock(subscribers_mtx);
+    subscribers.erase(subscription);
+    subscribers_size.store(subscribers.size(), std::memory_order_relaxed);
+}
+
+void ChangeFeed::notify() {
+    // Флаг снимается до обхода: изменения, записанные во время обхода,
+    // поставят новое сообщение. exchange, а не store: так обход видит события
+    // писателей, которые застали флаг поднятым и сообщение не ставили
+    notify_pending.exchange(false, std::memory_order_acq_rel);
+    std::vector<Waker> wakers;
+    {
+        std::lock_guard<std::mutex> lock(subscribers_mtx);
+        wakers.reserve(subscribers.size());
+        for (auto& entry : subscribers) wakers.push_back(entry.second);
+    }
+    for (auto& waker : wakers) waker();
+}
\ No newline at end of file
@@ -0,0 +1,106 @@
+#pragma once
+#ifndef CHANGE_FEED_H
+#define CHANGE_FEED_H
+
+#include "queue.h"
+#include <mutex>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <functional>
+#include <unordered_map>
+#include <string>
+#include <memory_resource>
+#include <cstdint>
+
+class TaskRecord;
+
+enum class ChangeType { Created, Updated, Deleted };
+
+// Изменение задачи. task - новая версия, для удаления - последняя версия перед ним
+struct ChangeEvent {
+    uint64_t seq = 0;
+    ChangeType type = ChangeType::Created;
+    int id = 0;
+    std::shared_ptr<const TaskRecord> task;
+
+    static const char* type_name(ChangeType type);
+    // {"seq":..,"type":"updated","task":{...}}; для удаления вместо task - "id"
+    void append_json(std::string& out) const;
+    void append_json(std::pmr::string& out) const;
+};
+
+// Лента изменений задач: кольцо последних capacity событий с возрастающими
+// номерами. Номера начинаются с текущего времени в микросекундах, поэтому
+// номер, полученный от предыдущего запуска сервера, оказывается старше
+// кольца и не принимается за текущий.
+// Писатели не берут общей блокировки: номер выдается атомарным счетчиком,
+// ячейка кольца защищена своим спин-замком, а читателям видны события до
+// границы, перед которой все номера уже дописаны.
+// Подписчики - функции пробуждения; после записи в кольцо их вызывает
+// одно сообщение в MessageQueue на пачку изменений, а не каждый писатель.
+// Подписчик должен сам дочитать кольцо: пробуждение лишь сообщает, что
+// появились события
+class ChangeFeed {
+public:
+    using Waker = std::function<void()>;
+
+    enum class ReadResult {
+        Ok,
+        Expired,  // события после since уже вытеснены из кольца
+        Invalid   // since больше последнего выданного номера
+    };
+
+    explicit ChangeFeed(MessageQueue& mq, size_t capacity = 65536);
+    ChangeFeed(const ChangeFeed&) = delete;
+    ChangeFeed& operator=(const ChangeFeed&) = delete;
+
+    // Вызывается под блокировкой шарда задачи, поэтому события одной задачи
+    // идут в порядке изменений
+    void append(ChangeType type, int id, std::shared_ptr<const TaskRecord> task);
+    // Забывает накопленные события (номера продолжают расти). Только пока
+    // нет писателей и читателей
+    void discard();
+
+    // Номер последнего события; до первого события - на единицу меньше первого номера
+    uint64_t last_seq() const;
+    // Добавляет в out не больше max событий с номерами больше since
+    ReadResult read(uint64_t since, size_t max, std::vector<ChangeEvent>& out) const;
+
+    uint64_t subscribe(Waker waker);
+    void unsubscribe(uint64_t subscription);
+    size_t subscriber_count() const { return subscribers_size.load(std::memory_order_relaxed); }
+
+private:
+    struct Slot {
+        std::atomic<uint64_t> seq{ 0 };  // номер записанного события
+        std::atomic<bool> busy{ false };
+        ChangeType type = ChangeType::Created;
+        int id = 0;
+        std::shared_ptr<const TaskRecord> task;
+
+        void lock();
+        void unlock() { busy.store(false, std::memory_order_release); }
+    };
+
+    void notify();
+    // Продвигает границу опубликованного после записи события seq
+    void publish(uint64_t seq);
+
+    std::unique_ptr<Slot[]> ring;
+    size_t capacity;
+    uint64_t first_seq;  // события с меньшими номерами забыты
+    alignas(64) std::atomic<uint64_t> next_seq;
+    // Последний номер, до которого все события записаны
+    alignas(64) std::atomic<uint64_t> published;
+
+    std::mutex subscribers_mtx;
+    std::unordered_map<uint64_t, Waker> subscribers;
+    uint64_t next_subscription = 1;
+    std::atomic<size_t> subscribers_size{ 0 };
+    // Сообщение с оповещением уже в очереди - следующие писатели его не добавляют
+    alignas(64) std::atomic<bool> notify_pending{ false };
+    MessageQueue& message_queue;
+};
+
+#endif
\ No newline at end of file
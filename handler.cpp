@@ -1,59 +1,374 @@
 #include "handler.h"
 #include <iostream>
+#include <cstring>
+#include <new>
 
-std::vector<Task> TaskManager::get_all_tasks() {
-    std::lock_guard<std::mutex> lock(mtx);
-    return tasks;
+Task TaskRecord::to_task() const {
+    Task task;
+    task.id = id;
+    task.title = title();
+    task.description = description();
+    task.status = status;
+    return task;
 }
 
-Task TaskManager::get_task_by_id(int id) {
-    std::lock_guard<std::mutex> lock(mtx);
-    for (const auto& t : tasks) {
-        if (t.id == id) return t;
+std::shared_ptr<TaskRecord> TaskRecord::create(SlabArena& arena, const TaskView& task) {
+    // JSON собирается в буфер потока, затем копируется в блок записи
+    thread_local std::string json;
+    json.clear();
+    TaskJsonFields fields;
+    task.append_json(json, fields);
+
+    // Экранирование только удлиняет строку: если длина значения в JSON
+    // совпала с исходной, там лежат те же байты и копия не нужна
+    bool title_copy = fields.title_size != task.title.size();
+    bool description_copy = fields.description_size != task.description.size();
+
+    size_t size = sizeof(TaskRecord) + json.size() + (title_copy ? task.title.size() : 0)
+        + (description_copy ? task.description.size() : 0);
+    TaskRecord* record = new (arena.allocate(size)) TaskRecord();
+    record->id = task.id;
+    record->status = task.status;
+    record->json_size = (uint32_t)json.size();
+    record->title_size = (uint32_t)task.title.size();
+    record->description_size = (uint32_t)task.description.size();
+
+    char* text = reinterpret_cast<char*>(record + 1);
+    memcpy(text, json.data(), json.size());
+    size_t end = json.size();
+    record->title_pos = (uint32_t)(title_copy ? end : fields.title_pos);
+    if (title_copy) {
+        memcpy(text + end, task.title.data(), task.title.size());
+        end += task.title.size();
+    }
+    record->description_pos = (uint32_t)(description_copy ? end : fields.description_pos);
+    if (description_copy) memcpy(text + end, task.description.data(), task.description.size());
+
+    // Блок управления shared_ptr тоже берется из арены
+    SlabArena* owner = &arena;
+    return std::shared_ptr<TaskRecord>(record, [owner](TaskRecord* r) {
+        size_t allocated = r->allocation_size();
+        r->~TaskRecord();
+        owner->deallocate(r, allocated);
+        }, ArenaAllocator<TaskRecord>(owner));
+}
+
+TaskSnapshot::TaskSnapshot(std::vector<ShardView> views) {
+    // Пустые шарды не участвуют в слиянии
+    for (auto& view : views) {
+        if (view->empty()) continue;
+        total += view->size();
+        shards.push_back(std::move(view));
+    }
+}
+
+TaskManager::TaskManager(MessageQueue& mq, size_t requested_shards) : message_queue(mq), change_feed(mq) {
+    shard_count = 1;
+    while (shard_count < requested_shards) shard_count <<= 1;
+    shard_mask = shard_count - 1;
+    shards = std::make_unique<Shard[]>(shard_count);
+}
+
+bool TaskManager::open_storage(const StorageOptions& options) {
+    auto new_storage = std::make_unique<TaskStorage>(options);
+
+    // Проигрывание идет до запуска сервера, блокировки не нужны
+    int recovered_next_id = 1;
+    bool ok = new_storage->recover(
+        [this](const TaskView& task) {
+            put_locked(shard_for(task.id), make_record(task, task.id));
+        },
+        [this](int id) {
+            erase_locked(shard_for(id), id);
+        },
+        recovered_next_id);
+    if (!ok) return false;
+    next_id = recovered_next_id;
+    // Восстановленные задачи - не изменения: подписчики получают их через GET /tasks
+    change_feed.discard();
+
+    // Снимок заказывается после ротации сегмента. Писатель добавляет запись в
+    // журнал и публикует ее в шарде под одной блокировкой, поэтому под
+    // блокировкой шарда видны все его записи из старых сегментов. Кэшированный
+    // снимок шарда читается без блокировки и может их еще не содержать
+    ok = new_storage->start([this](const TaskStorage::TaskCallback& emit) {
+        int snapshot_next_id = next_id.load();
+        std::vector<TaskPtr> tasks;
+        for (size_t i = 0; i < shard_count; i++) {
+            tasks.clear();
+            {
+                std::shared_lock<std::shared_mutex> lock(shards[i].mtx);
+                tasks.reserve(shards[i].tasks.size());
+                for (const auto& [id, task] : shards[i].tasks) tasks.push_back(task);
+            }
+            for (const TaskPtr& task : tasks) emit(task->view());
+        }
+        return snapshot_next_id;
+        });
+    if (!ok) return false;
+
+    storage = std::move(new_storage);
+    return true;
+}
+
+std::shared_ptr<TaskRecord> TaskManager::make_record(TaskView task, int id) {
+    task.id = id;
+    return TaskRecord::create(arena, task);
+}
+
+void TaskManager::put_locked(Shard& shard, std::shared_ptr<TaskRecord> task) {
+    int id = task->id;
+    size_t status = (size_t)task->status;
+    // Под блокировкой шарда версии одной задачи идут строго по возрастанию
+    task->version = version_clock.fetch_add(1, std::memory_order_relaxed) + 1;
+
+    auto it = shard.tasks.find(id);
+    if (it != shard.tasks.end()) {
+        size_t old_status = (size_t)it->second->status;
+        shard.by_status[old_status].erase(id);
+        status_counts[old_status].fetch_sub(1, std::memory_order_relaxed);
+        invalidate(shard, it->second->status);
+        it->second = task;
+        change_feed.append(ChangeType::Updated, id, std::move(task));
     }
+    else {
+        shard.tasks.emplace(id, task);
+        task_count.fetch_add(1, std::memory_order_relaxed);
+        change_feed.append(ChangeType::Created, id, std::move(task));
+    }
+
+    shard.by_status[status].insert(id);
+    status_counts[status].fetch_add(1, std::memory_order_relaxed);
+    invalidate(shard, (TaskStatus)status);
+    collection_changes.fetch_add(1, std::memory_order_release);
+}
+
+TaskPtr TaskManager::erase_locked(Shard& shard, int id) {
+    auto it = shard.tasks.find(id);
+    if (it == shard.tasks.end()) return nullptr;
+
+    TaskPtr old = std::move(it->second);
+    shard.tasks.erase(it);
+    shard.by_status[(size_t)old->status].erase(id);
+    status_counts[(size_t)old->status].fetch_sub(1, std::memory_order_relaxed);
+    task_count.fetch_sub(1, std::memory_order_relaxed);
+    invalidate(shard, old->status);
+    collection_changes.fetch_add(1, std::memory_order_release);
+    change_feed.append(ChangeType::Deleted, id, old);
+    return old;
+}
+
+// Читатели не берут блокировку, если снимок шарда актуален
+TaskSnapshot::ShardView TaskManager::shard_snapshot(Shard& shard, size_t slot) {
+    TaskSnapshot::ShardView view = std::atomic_load(&shard.snapshots[slot]);
+    if (view) return view;
+
+    std::shared_lock<std::shared_mutex> lock(shard.mtx);
+    auto tasks = std::make_shared<std::vector<TaskPtr>>();
+    if (slot == 0) {
+        tasks->reserve(shard.tasks.size());
+        for (const auto& [id, t] : shard.tasks) tasks->push_back(t);
+    }
+    else {
+        // По индексу просматриваются только задачи с нужным статусом
+        const auto& ids = shard.by_status[slot - 1];
+        tasks->reserve(ids.size());
+        for (int id : ids) tasks->push_back(shard.tasks.find(id)->second);
+    }
+    std::sort(tasks->begin(), tasks->end(),
+        [](const TaskPtr& a, const TaskPtr& b) { return a->id < b->id; });
+
+    // Публикуем под shared-блокировкой: писатель не может сбросить снимок,
+    // пока мы его не опубликовали
+    view = std::move(tasks);
+    std::atomic_store(&shard.snapshots[slot], view);
+    return view;
+}
+
+// Сбрасывает общий снимок шарда и снимок затронутого статуса
+void TaskManager::invalidate(Shard& shard, TaskStatus status) {
+    std::atomic_store(&shard.snapshots[0], TaskSnapshot::ShardView());
+    std::atomic_store(&shard.snapshots[1 + (size_t)status], TaskSnapshot::ShardView());
+}
+
+void TaskManager::wait_durable(uint64_t lsn) {
+    if (storage && !storage->wait_durable(lsn)) throw StorageError("Изменение не записано в журнал");
+}
+
+TaskSnapshot TaskManager::collect(size_t slot) {
+    std::vector<TaskSnapshot::ShardView> views;
+    views.reserve(shard_count);
+    for (size_t i = 0; i < shard_count; i++) {
+        views.push_back(shard_snapshot(shards[i], slot));
+    }
+    return TaskSnapshot(std::move(views));
+}
+
+TaskSnapshot TaskManager::get_all_tasks() {
+    return collect(0);
+}
+
+TaskSnapshot TaskManager::get_tasks_by_status(TaskStatus status) {
+    return collect(1 + (size_t)status);
+}
+
+Task TaskManager::get_task_by_id(int id) {
+    Shard& shard = shard_for(id);
+    std::shared_lock<std::shared_mutex> lock(shard.mtx);
+    auto it = shard.tasks.find(id);
+    if (it != shard.tasks.end()) return it->second->to_task();
     return Task{};
 }
 
+TaskPtr TaskManager::find_task(int id) {
+    Shard& shard = shard_for(id);
+    std::shared_lock<std::shared_mutex> lock(shard.mtx);
+    auto it = shard.tasks.find(id);
+    if (it != shard.tasks.end()) return it->second;
+    return nullptr;
+}
+
 int TaskManager::create_task(const Task& task) {
-    std::lock_guard<std::mutex> lock(mtx);
-    Task new_task = task;
-    new_task.id = next_id++;
-    tasks.push_back(new_task);
-    return new_task.id;
+    int id = next_id.fetch_add(1, std::memory_order_relaxed);
+    auto new_task = make_record(task.view(), id);
+
+    Shard& shard = shard_for(id);
+    uint64_t lsn = 0;
+    {
+        std::lock_guard<std::shared_mutex> lock(shard.mtx);
+        if (storage) lsn = storage->append_put(new_task->view());
+        put_locked(shard, std::move(new_task));
+    }
+    wait_durable(lsn);
+    return id;
 }
 
 bool TaskManager::update_task(int id, const Task& task) {
-    std::lock_guard<std::mutex> lock(mtx);
-    for (auto& t : tasks) {
-        if (t.id == id) {
-            t = task;
-            t.id = id;
-            return true;
-        }
+    auto updated = make_record(task.view(), id);
+
+    Shard& shard = shard_for(id);
+    uint64_t lsn = 0;
+    {
+        std::lock_guard<std::shared_mutex> lock(shard.mtx);
+        if (shard.tasks.find(id) == shard.tasks.end()) return false;
+        if (storage) lsn = storage->append_put(updated->view());
+        put_locked(shard, std::move(updated));
     }
-    return false;
+    wait_durable(lsn);
+    return true;
 }
 
-//   -   
-bool TaskManager::patch_task(int id, const std::string& status) {
-    std::lock_guard<std::mutex> lock(mtx);
-    for (auto& t : tasks) {
-        if (t.id == id) {
-            t.status = Task::string_to_status(status);
-            return true;
-        }
+// НОВЫЙ МЕТОД - обновление только статуса
+TaskPtr TaskManager::patch_task(int id, TaskStatus status) {
+    Shard& shard = shard_for(id);
+    uint64_t lsn = 0;
+    TaskPtr result;
+    {
+        std::lock_guard<std::shared_mutex> lock(shard.mtx);
+        auto it = shard.tasks.find(id);
+        if (it == shard.tasks.end()) return nullptr;
+        // Строки берутся из текущей версии и копируются сразу в новую запись
+        TaskView changed = it->second->view();
+        changed.status = status;
+        auto updated = make_record(changed, id);
+        if (storage) lsn = storage->append_put(updated->view());
+        result = updated;
+        put_locked(shard, std::move(updated));
     }
-    return false;
+    wait_durable(lsn);
+    return result;
 }
 
 bool TaskManager::delete_task(int id) {
-    std::lock_guard<std::mutex> lock(mtx);
-    auto it = std::remove_if(tasks.begin(), tasks.end(),
-        [id](const Task& t) { return t.id == id; });
+    Shard& shard = shard_for(id);
+    uint64_t lsn = 0;
+    {
+        std::lock_guard<std::shared_mutex> lock(shard.mtx);
+        if (!erase_locked(shard, id)) return false;
+        if (storage) lsn = storage->append_delete(id);
+    }
+    wait_durable(lsn);
+    return true;
+}
 
-    if (it != tasks.end()) {
-        tasks.erase(it, tasks.end());
-        return true;
+template <typename GetId>
+std::vector<std::pair<size_t, size_t>> TaskManager::group_by_shard(size_t count, GetId get_id) const {
+    std::vector<std::pair<size_t, size_t>> order(count);
+    for (size_t i = 0; i < count; i++) {
+        order[i] = { (size_t)get_id(i) & shard_mask, i };
     }
-    return false;
+    std::stable_sort(order.begin(), order.end(),
+        [](const auto& a, const auto& b) { return a.first < b.first; });
+    return order;
+}
+
+std::vector<TaskPtr> TaskManager::create_tasks(const std::vector<Task>& tasks) {
+    std::vector<TaskPtr> results(tasks.size());
+    if (tasks.empty()) return results;
+
+    // Непрерывный диапазон id на весь пакет; JSON готовится до блокировок
+    int first_id = next_id.fetch_add((int)tasks.size(), std::memory_order_relaxed);
+    std::vector<std::shared_ptr<TaskRecord>> records(tasks.size());
+    for (size_t i = 0; i < tasks.size(); i++) {
+        records[i] = make_record(tasks[i].view(), first_id + (int)i);
+    }
+
+    auto order = group_by_shard(tasks.size(), [first_id](size_t i) { return first_id + (int)i; });
+    uint64_t lsn = 0;
+    for (size_t begin = 0; begin < order.size();) {
+        Shard& shard = shards[order[begin].first];
+        size_t end = begin;
+        std::lock_guard<std::shared_mutex> lock(shard.mtx);
+        for (; end < order.size() && order[end].first == order[begin].first; end++) {
+            size_t i = order[end].second;
+            if (storage) lsn = std::max(lsn, storage->append_put(records[i]->view()));
+            results[i] = records[i];
+            put_locked(shard, std::move(records[i]));
+        }
+        begin = end;
+    }
+    wait_durable(lsn);
+    return results;
+}
+
+std::vector<TaskPtr> TaskManager::apply_changes(const std::vector<TaskChange>& changes) {
+    std::vector<TaskPtr> results(changes.size());
+    auto order = group_by_shard(changes.size(), [&changes](size_t i) { return changes[i].id; });
+
+    uint64_t lsn = 0;
+    for (size_t begin = 0; begin < order.size();) {
+        Shard& shard = shards[order[begin].first];
+        size_t end = begin;
+        std::lock_guard<std::shared_mutex> lock(shard.mtx);
+        for (; end < order.size() && order[end].first == order[begin].first; end++) {
+            size_t i = order[end].second;
+            const TaskChange& change = changes[i];
+            auto it = shard.tasks.find(change.id);
+            if (it == shard.tasks.end()) continue;
+
+            TaskView changed = it->second->view();
+            if (change.title) changed.title = *change.title;
+            if (change.description) changed.description = *change.description;
+            if (change.status) changed.status = *change.status;
+            auto updated = make_record(changed, change.id);
+            if (storage) lsn = std::max(lsn, storage->append_put(updated->view()));
+            results[i] = updated;
+            put_locked(shard, std::move(updated));
+        }
+        begin = end;
+    }
+    wait_durable(lsn);
+    return results;
+}
+
+size_t TaskManager::size() const {
+    return task_count.load(std::memory_order_relaxed);
+}
+
+size_t TaskManager::count_by_status(TaskStatus status) const {
+    return status_counts[(size_t)status].load(std::memory_order_relaxed);
+}
+
+uint64_t TaskManager::collection_version() const {
+    return collection_changes.load(std::memory_order_acquire);
 }
\ No newline at end of file
@@ -4,26 +4,210 @@
 
 #include "task.h"
 #include "queue.h"
+#include "storage.h"
+#include "arena.h"
+#include "change_feed.h"
 #include <vector>
 #include <mutex>
+#include <shared_mutex>
+#include <unordered_map>
+#include <unordered_set>
+#include <memory>
+#include <atomic>
 #include <algorithm>
+#include <optional>
+
+// Версия задачи в хранилище: данные, номер версии и JSON, сериализованный
+// один раз при записи. Объект неизменяем: запись заменяет указатель,
+// а читатели продолжают пользоваться старой версией вместе с ее JSON.
+// JSON лежит одним блоком сразу за полями записи, блок выделяется из арены
+// TaskManager - отдельных строк в куче нет, наружу отдаются только string_view.
+// Заголовок и описание - срезы значений в JSON; отдельная копия за JSON
+// хранится, только если при сериализации строку пришлось экранировать.
+class TaskRecord {
+public:
+    int id = 0;
+    TaskStatus status = TaskStatus::TODO;
+    uint64_t version = 0;
+
+    std::string_view title() const { return std::string_view(text() + title_pos, title_size); }
+    std::string_view description() const { return std::string_view(text() + description_pos, description_size); }
+    std::string_view json() const { return std::string_view(text(), json_size); }
+
+    TaskView view() const { return TaskView{ id, title(), description(), status }; }
+    // Копия с собственными строками (для изменения и создания новой версии)
+    Task to_task() const;
+
+    // Размер блока вместе с текстом: копии строк идут после JSON
+    size_t allocation_size() const {
+        return sizeof(TaskRecord) + json_size + (title_pos >= json_size ? title_size : 0)
+            + (description_pos >= json_size ? description_size : 0);
+    }
+
+    // Создает запись в арене; память возвращается в арену вместе с последней ссылкой
+    static std::shared_ptr<TaskRecord> create(SlabArena& arena, const TaskView& task);
+
+private:
+    TaskRecord() = default;
+
+    const char* text() const { return reinterpret_cast<const char*>(this + 1); }
+
+    uint32_t json_size = 0;
+    uint32_t title_pos = 0;
+    uint32_t title_size = 0;
+    uint32_t description_pos = 0;
+    uint32_t description_size = 0;
+};
+
+using TaskPtr = std::shared_ptr<const TaskRecord>;
+
+// Неизменяемый снимок всех задач. Держит ссылки на снимки шардов,
+// строки задач при этом не копируются.
+class TaskSnapshot {
+public:
+    using ShardView = std::shared_ptr<const std::vector<TaskPtr>>;
+
+    explicit TaskSnapshot(std::vector<ShardView> shards);
+
+    size_t size() const { return total; }
+    bool empty() const { return total == 0; }
+
+    // Обходит задачи с id > after_id по возрастанию id, пока fn возвращает true.
+    // fn получает const TaskRecord&
+    template <typename Fn>
+    void for_each(Fn fn, int after_id = 0) const;
+
+private:
+    std::vector<ShardView> shards;
+    size_t total = 0;
+};
+
+// Частичное изменение задачи для пакетного PATCH: меняются только заданные поля
+struct TaskChange {
+    int id = 0;
+    std::optional<std::string> title;
+    std::optional<std::string> description;
+    std::optional<TaskStatus> status;
+};
 
 class TaskManager {
 public:
-    TaskManager(MessageQueue& mq) : message_queue(mq) {}
+    // requested_shards округляется вверх до степени двойки
+    TaskManager(MessageQueue& mq, size_t requested_shards = 64);
 
-    std::vector<Task> get_all_tasks();
+    // Восстанавливает задачи с диска и включает журналирование изменений
+    bool open_storage(const StorageOptions& options);
+
+    TaskSnapshot get_all_tasks();
+    // Задачи с заданным статусом, по индексу - без просмотра остальных
+    TaskSnapshot get_tasks_by_status(TaskStatus status);
     Task get_task_by_id(int id);
+    // Текущая версия задачи с готовым JSON; nullptr, если задачи нет
+    TaskPtr find_task(int id);
     int create_task(const Task& task);
     bool update_task(int id, const Task& task);
-    bool patch_task(int id, const std::string& status);  //  
+    // Установленная версия задачи; nullptr, если задачи нет
+    TaskPtr patch_task(int id, TaskStatus status);  // НОВЫЙ МЕТОД
     bool delete_task(int id);
 
+    // Пакетные операции: каждый шард блокируется один раз на весь пакет,
+    // журнал сбрасывается на диск один раз. Результаты - в порядке входных
+    // элементов; для apply_changes nullptr означает, что задачи нет.
+    // Изменения одной задачи применяются в порядке следования в пакете
+    std::vector<TaskPtr> create_tasks(const std::vector<Task>& tasks);
+    std::vector<TaskPtr> apply_changes(const std::vector<TaskChange>& changes);
+    size_t size() const;
+    size_t count_by_status(TaskStatus status) const;
+    // Растет при каждом изменении любой задачи. Читается до снимка: если снимок
+    // уже содержит более новые данные, следующий запрос просто получит их еще раз
+    uint64_t collection_version() const;
+    // Лента изменений: в нее попадает каждая вставка, замена и удаление
+    ChangeFeed& changes() { return change_feed; }
+
+    static constexpr size_t status_count = 3;
+
 private:
-    std::vector<Task> tasks;
-    int next_id = 1;
+    // Задачи разбиты по шардам по id, у каждого шарда своя блокировка,
+    // поэтому запросы к разным задачам не конкурируют за один мьютекс
+    struct alignas(64) Shard {
+        std::shared_mutex mtx;
+        std::unordered_map<int, TaskPtr> tasks;
+        // Вторичный индекс: id задач шарда по статусам
+        std::unordered_set<int> by_status[status_count];
+        // Опубликованные снимки шарда (отсортированы по id): [0] - все задачи,
+        // [1 + статус] - задачи со статусом. Писатели сбрасывают затронутые,
+        // первый читатель после записи собирает заново.
+        TaskSnapshot::ShardView snapshots[1 + status_count];
+    };
+
+    Shard& shard_for(int id) { return shards[(size_t)id & shard_mask]; }
+    TaskSnapshot::ShardView shard_snapshot(Shard& shard, size_t slot);
+    TaskSnapshot collect(size_t slot);
+    static void invalidate(Shard& shard, TaskStatus status);
+    // Ждет сохранения записи журнала; StorageError, если журнал ее не сохранил.
+    // Изменение к этому моменту уже видно в памяти
+    void wait_durable(uint64_t lsn);
+    // Новая версия задачи с сериализованным JSON (номер версии выдает put_locked)
+    std::shared_ptr<TaskRecord> make_record(TaskView task, int id);
+    // Номера элементов пакета, сгруппированные по шардам (порядок внутри шарда сохраняется)
+    template <typename GetId>
+    std::vector<std::pair<size_t, size_t>> group_by_shard(size_t count, GetId get_id) const;
+    // Под эксклюзивной блокировкой шарда: вставка/замена/удаление с обновлением
+    // индекса и версий
+    void put_locked(Shard& shard, std::shared_ptr<TaskRecord> task);
+    TaskPtr erase_locked(Shard& shard, int id);
+
+    // Объявлена первой: записи задач возвращают в нее память, поэтому
+    // она уничтожается после шардов и хранилища
+    SlabArena arena;
+    std::unique_ptr<Shard[]> shards;
+    size_t shard_count;
+    size_t shard_mask;
+    std::atomic<int> next_id{ 1 };
+    std::atomic<size_t> task_count{ 0 };
+    std::atomic<size_t> status_counts[status_count] = {};
+    std::atomic<uint64_t> version_clock{ 0 };
+    std::atomic<uint64_t> collection_changes{ 0 };
     MessageQueue& message_queue;
-    std::mutex mtx;
+    // После арены: события держат ссылки на записи
+    ChangeFeed change_feed;
+    // Объявлен последним: останавливается первым, пока шарды еще живы
+    std::unique_ptr<TaskStorage> storage;
 };
 
+template <typename Fn>
+void TaskSnapshot::for_each(Fn fn, int after_id) const {
+    // Слияние отсортированных снимков шардов через кучу по id
+    using Cursor = std::pair<int, size_t>;  // id очередной задачи, номер шарда
+    auto greater = [](const Cursor& a, const Cursor& b) { return a.first > b.first; };
+
+    std::vector<Cursor> heap;
+    std::vector<size_t> pos(shards.size(), 0);
+    heap.reserve(shards.size());
+    for (size_t i = 0; i < shards.size(); i++) {
+        const std::vector<TaskPtr>& tasks = *shards[i];
+        if (after_id > 0) {
+            pos[i] = std::upper_bound(tasks.begin(), tasks.end(), after_id,
+                [](int id, const TaskPtr& t) { return id < t->id; }) - tasks.begin();
+        }
+        if (pos[i] < tasks.size()) heap.emplace_back(tasks[pos[i]]->id, i);
+    }
+    std::make_heap(heap.begin(), heap.end(), greater);
+
+    while (!heap.empty()) {
+        std::pop_heap(heap.begin(), heap.end(), greater);
+        size_t shard = heap.back().second;
+        const std::vector<TaskPtr>& tasks = *shards[shard];
+        if (!fn(*tasks[pos[shard]])) return;
+
+        if (++pos[shard] < tasks.size()) {
+            heap.back().first = tasks[pos[shard]]->id;
+            std::push_heap(heap.begin(), heap.end(), greater);
+        }
+        else {
+            heap.pop_back();
+        }
+    }
+}
+
 #endif
\ No newline at end of file
@@ -1,14 +1,26 @@
-// httplib.h -   
+// httplib.h - УПРОЩЕННАЯ РАБОЧАЯ ВЕРСИЯ
 #pragma once
 
 #include <iostream>
 #include <string>
+#include <cctype>
+#include <cstring>
 #include <functional>
-#include <regex>
-#include <map>
+#include <string_view>
+#include <memory_resource>
 #include <thread>
 #include <atomic>
 #include <vector>
+#include <deque>
+#include <algorithm>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <memory>
+#include <unordered_map>
+#include <charconv>
+#include <cstdio>
+#include <array>
 
 #ifdef _WIN32
 #define WIN32_LEAN_AND_MEAN
@@ -21,40 +33,1935 @@
 #include <netinet/in.h>
 #include <unistd.h>
 #include <arpa/inet.h>
+#include <netinet/tcp.h>
+#include <fcntl.h>
+#include <sys/uio.h>
+#include <cerrno>
+#endif
+
+// На Linux соединения обслуживает неблокирующий цикл на epoll
+#if defined(__linux__) && !defined(CPPHTTPLIB_NO_EPOLL)
+#define CPPHTTPLIB_USE_EPOLL
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+// Сжатие ответов gzip/deflate (CMake включает его, если найден zlib)
+#ifdef CPPHTTPLIB_ZLIB_SUPPORT
+#include <zlib.h>
 #endif
 
 namespace httplib {
 
-#ifdef _WIN32
-    typedef SOCKET socket_t;
-    inline socket_t invalid_socket = INVALID_SOCKET;
+#ifdef _WIN32
+    typedef SOCKET socket_t;
+    inline socket_t invalid_socket = INVALID_SOCKET;
+#else
+    typedef int socket_t;
+    inline socket_t invalid_socket = -1;
+#endif
+
+// Число рабочих потоков по умолчанию (0 - по числу ядер)
+#ifndef CPPHTTPLIB_THREAD_POOL_COUNT
+#define CPPHTTPLIB_THREAD_POOL_COUNT 0
+#endif
+
+// Сколько принятых соединений может ждать свободный поток
+#ifndef CPPHTTPLIB_MAX_QUEUED_CONNECTIONS
+#define CPPHTTPLIB_MAX_QUEUED_CONNECTIONS 1024
+#endif
+
+// Число потоков epoll (0 - по числу ядер)
+#ifndef CPPHTTPLIB_EVENT_LOOP_COUNT
+#define CPPHTTPLIB_EVENT_LOOP_COUNT 0
+#endif
+
+// Длина очереди ожидающих accept() соединений
+#ifndef CPPHTTPLIB_LISTEN_BACKLOG
+#define CPPHTTPLIB_LISTEN_BACKLOG SOMAXCONN
+#endif
+
+// Ограничения на размер запроса
+#ifndef CPPHTTPLIB_HEADER_MAX_LENGTH
+#define CPPHTTPLIB_HEADER_MAX_LENGTH 8192
+#endif
+
+#ifndef CPPHTTPLIB_HEADER_MAX_COUNT
+#define CPPHTTPLIB_HEADER_MAX_COUNT 100
+#endif
+
+#ifndef CPPHTTPLIB_PAYLOAD_MAX_LENGTH
+#define CPPHTTPLIB_PAYLOAD_MAX_LENGTH (8 * 1024 * 1024)
+#endif
+
+// Сколько соединений может быть открыто одновременно (0 - без ограничения),
+// сверх - 503 сразу после accept()
+#ifndef CPPHTTPLIB_MAX_CONNECTIONS
+#define CPPHTTPLIB_MAX_CONNECTIONS 0
+#endif
+
+// Сколько миллисекунд запрос может ждать обработки (0 - без ограничения),
+// дольше - 503 без вызова обработчика
+#ifndef CPPHTTPLIB_REQUEST_TIMEOUT_MSEC
+#define CPPHTTPLIB_REQUEST_TIMEOUT_MSEC 0
+#endif
+
+// Через сколько секунд простоя закрывается keep-alive соединение
+#ifndef CPPHTTPLIB_KEEPALIVE_TIMEOUT_SECOND
+#define CPPHTTPLIB_KEEPALIVE_TIMEOUT_SECOND 5
+#endif
+
+// Тела короче этого порога копируются в буфер заголовков (один сегмент
+// дешевле лишнего iovec), длинные отправляются отдельным сегментом без копирования
+#ifndef CPPHTTPLIB_COPY_THRESHOLD
+#define CPPHTTPLIB_COPY_THRESHOLD 1024
+#endif
+
+// Тела короче этого порога не сжимаются: выигрыш меньше заголовков и затрат CPU
+#ifndef CPPHTTPLIB_COMPRESSION_THRESHOLD
+#define CPPHTTPLIB_COMPRESSION_THRESHOLD 1024
+#endif
+
+// Уровень сжатия zlib (1 - быстрее, 9 - плотнее)
+#ifndef CPPHTTPLIB_COMPRESSION_LEVEL
+#define CPPHTTPLIB_COMPRESSION_LEVEL 6
+#endif
+
+// Начальный размер памяти запроса на соединение. Запрос и ответ, уместившиеся
+// в нее, не обращаются к malloc; больше - арена берет блоки у кучи до конца ответа
+#ifndef CPPHTTPLIB_REQUEST_ARENA_SIZE
+#define CPPHTTPLIB_REQUEST_ARENA_SIZE 8192
+#endif
+
+    using Headers = std::pmr::vector<std::pair<std::string_view, std::string_view>>;
+    using Params = std::pmr::vector<std::pair<std::string_view, std::string_view>>;
+
+    namespace detail {
+
+        inline bool iequals(std::string_view a, std::string_view b) {
+            if (a.size() != b.size()) return false;
+            for (size_t i = 0; i < a.size(); i++) {
+                if (std::tolower((unsigned char)a[i]) != std::tolower((unsigned char)b[i])) return false;
+            }
+            return true;
+        }
+
+    } // namespace detail
+
+    // Все string_view указывают в буфер соединения и действительны только
+    // на время вызова обработчика. Контейнеры берут память у арены запроса
+    // (resource()), ее же обработчик может использовать для временных буферов
+    struct Request {
+        explicit Request(std::pmr::memory_resource* mr = std::pmr::get_default_resource())
+            : headers(mr), path_params(mr), params(mr), params_buffer(mr) {}
+
+        std::string_view method;
+        std::string_view target;   // путь вместе со строкой запроса
+        std::string_view path;
+        std::string_view version;
+        std::string_view body;
+        Headers headers;
+        // Параметры пути ({id} и т.п.), указывают внутрь path
+        Params path_params;
+        // Параметры строки запроса (?limit=10&status=done), уже декодированные
+        Params params;
+        // Сюда декодируются параметры с %XX и '+', остальные указывают прямо в target
+        std::pmr::string params_buffer;
+        // IPv4-адрес клиента в порядке байт сети (0 - неизвестен)
+        uint32_t remote_addr = 0;
+        // Когда запрос пришел на сервер (по умолчанию - неизвестно): от этого
+        // момента отсчитывается допустимое ожидание обработки
+        std::chrono::steady_clock::time_point received_at;
+
+        std::pmr::memory_resource* resource() const {
+            return headers.get_allocator().resource();
+        }
+
+        std::string_view get_path_param(std::string_view name) const {
+            for (const auto& [key, value] : path_params) {
+                if (key == name) return value;
+            }
+            return {};
+        }
+
+        bool has_param(std::string_view name) const {
+            for (const auto& [key, value] : params) {
+                if (key == name) return true;
+            }
+            return false;
+        }
+
+        std::string_view get_param_value(std::string_view name) const {
+            for (const auto& [key, value] : params) {
+                if (key == name) return value;
+            }
+            return {};
+        }
+
+        bool has_header(std::string_view name) const {
+            for (const auto& [key, value] : headers) {
+                if (detail::iequals(key, name)) return true;
+            }
+            return false;
+        }
+
+        std::string_view get_header_value(std::string_view name) const {
+            for (const auto& [key, value] : headers) {
+                if (detail::iequals(key, name)) return value;
+            }
+            return {};
+        }
+    };
+
+    // Приемник данных потокового ответа
+    struct DataSink {
+        std::function<bool(const char* data, size_t length)> write;
+        std::function<void()> done;
+        // Можно вызвать из любого потока (и после завершения ответа): провайдер,
+        // который ничего не записал, будет вызван снова
+        std::function<void()> wake;
+    };
+
+    // Вызывается, когда сокет готов принять следующую порцию; offset - сколько
+    // байт уже отдано. Должен записать данные в sink и/или вызвать sink.done().
+    // Если данных пока нет, провайдер возвращает true, ничего не записав:
+    // соединение ждет без потока до sink.wake() или не дольше секунды
+    // (по этому повтору провайдер отсчитывает свои тайм-ауты).
+    // Возврат false обрывает соединение.
+    using ContentProviderWithoutLength = std::function<bool(size_t offset, DataSink& sink)>;
+
+    // Тело и заголовки лежат в арене запроса и освобождаются вместе с ней
+    // после отправки ответа
+    struct Response {
+        explicit Response(std::pmr::memory_resource* mr = std::pmr::get_default_resource())
+            : body(mr), headers(mr) {}
+
+        int status = 200;
+        std::pmr::string body;
+        // Общее неизменяемое тело (кэш, статическая страница, запись задачи):
+        // shared_view указывает в память, которую держит shared_owner, и
+        // отправляется без копирования. Если shared_owner задан, body не используется
+        std::shared_ptr<const void> shared_owner;
+        std::string_view shared_view;
+        std::pmr::vector<std::pair<std::pmr::string, std::pmr::string>> headers;
+        // Если задан, тело отдается по частям с Transfer-Encoding: chunked
+        ContentProviderWithoutLength content_provider;
+
+        // Заменяет значение, если заголовок с таким именем уже задан
+        void set_header(std::string_view name, std::string_view value) {
+            for (auto& [key, current] : headers) {
+                if (key == name) {
+                    current = value;
+                    return;
+                }
+            }
+            headers.emplace_back(name, value);
+        }
+
+        void set_content(std::string_view s, std::string_view content_type) {
+            begin_content(content_type) = s;
+        }
+
+        // Очищает тело и возвращает его для сборки на месте, без промежуточной строки
+        std::pmr::string& begin_content(std::string_view content_type) {
+            body.clear();
+            shared_owner = nullptr;
+            set_header("Content-Type", content_type);
+            return body;
+        }
+
+        void set_content(std::shared_ptr<const std::string> s, std::string_view content_type) {
+            std::string_view view(*s);
+            set_content(std::move(s), view, content_type);
+        }
+
+        void set_content(std::shared_ptr<const void> owner, std::string_view data, std::string_view content_type) {
+            body.clear();
+            shared_owner = std::move(owner);
+            shared_view = data;
+            set_header("Content-Type", content_type);
+        }
+
+        size_t body_size() const {
+            return shared_owner ? shared_view.size() : body.size();
+        }
+
+        void set_chunked_content_provider(std::string_view content_type, ContentProviderWithoutLength provider) {
+            set_header("Content-Type", content_type);
+            content_provider = std::move(provider);
+        }
+    };
+
+    namespace detail {
+
+        inline void close_socket(socket_t sock) {
+#ifdef _WIN32
+            closesocket(sock);
+#else
+            close(sock);
+#endif
+        }
+
+        inline int from_hex_digit(char c) {
+            if (c >= '0' && c <= '9') return c - '0';
+            if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+            if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+            return -1;
+        }
+
+        // Декодирует %XX и '+' (пробел) в конец out
+        inline std::string_view decode_url(std::string_view s, std::pmr::string& out) {
+            size_t start = out.size();
+            for (size_t i = 0; i < s.size(); i++) {
+                if (s[i] == '+') {
+                    out += ' ';
+                }
+                else if (s[i] == '%' && i + 2 < s.size() && from_hex_digit(s[i + 1]) >= 0 &&
+                    from_hex_digit(s[i + 2]) >= 0) {
+                    out += (char)(from_hex_digit(s[i + 1]) * 16 + from_hex_digit(s[i + 2]));
+                    i += 2;
+                }
+                else {
+                    out += s[i];
+                }
+            }
+            return std::string_view(out.data() + start, out.size() - start);
+        }
+
+        // Разбирает строку запроса из req.target в req.params
+        inline void parse_query(Request& req) {
+            req.params.clear();
+            req.params_buffer.clear();
+            size_t question = req.target.find('?');
+            if (question == std::string_view::npos) return;
+            std::string_view query = req.target.substr(question + 1);
+
+            // Декодированный текст не длиннее исходного, поэтому буфер не перераспределяется
+            // и string_view на него остаются действительными
+            req.params_buffer.reserve(query.size());
+            while (!query.empty()) {
+                size_t amp = query.find('&');
+                std::string_view pair = query.substr(0, amp);
+                query = amp == std::string_view::npos ? std::string_view() : query.substr(amp + 1);
+                if (pair.empty()) continue;
+
+                size_t eq = pair.find('=');
+                std::string_view key = pair.substr(0, eq);
+                std::string_view value = eq == std::string_view::npos ? std::string_view() : pair.substr(eq + 1);
+                auto decode = [&req](std::string_view v) {
+                    return v.find_first_of("%+") == std::string_view::npos ? v : decode_url(v, req.params_buffer);
+                };
+                key = decode(key);
+                value = decode(value);
+                req.params.emplace_back(key, value);
+            }
+        }
+
+        // Исходящие данные соединения в виде цепочки сегментов для writev/sendmsg.
+        // Заголовки и мелкие тела дописываются в последний собственный сегмент,
+        // большие тела ссылаются на арену запроса или разделяются (shared_ptr) без копирования.
+        class OutputQueue {
+        public:
+            static const int max_iov = 16;
+
+            void append(std::string_view data) {
+                tail().append(data.data(), data.size());
+            }
+
+            // data не копируется: вызывающий держит память до опустошения очереди
+            // (тело ответа в арене запроса)
+            void append_borrowed(std::string_view data) {
+                if (data.size() < CPPHTTPLIB_COPY_THRESHOLD) {
+                    append(data);
+                    return;
+                }
+                segments_.emplace_back();
+                segments_.back().external = data;
+                segments_.back().is_external = true;
+            }
+
+            // data остается действительной, пока жив owner
+            void append(std::shared_ptr<const void> owner, std::string_view data) {
+                if (data.size() < CPPHTTPLIB_COPY_THRESHOLD) {
+                    append(data);
+                    return;
+                }
+                segments_.emplace_back();
+                segments_.back().shared = std::move(owner);
+                segments_.back().external = data;
+                segments_.back().is_external = true;
+            }
+
+            // Собственный сегмент в конце очереди для дописывания на месте
+            std::string& tail() {
+                if (segments_.empty() || segments_.back().is_external) segments_.emplace_back();
+                return segments_.back().owned;
+            }
+
+            bool empty() const {
+                for (size_t i = 0; i < segments_.size(); i++) {
+                    if (segments_[i].view().size() > (i == 0 ? head_pos_ : 0)) return false;
+                }
+                return true;
+            }
+
+            // Первые max неотправленных кусков; возвращает их число
+            int peek(std::string_view* parts, int max) const {
+                int count = 0;
+                for (size_t i = 0; i < segments_.size() && count < max; i++) {
+                    std::string_view view = segments_[i].view();
+                    if (i == 0) view.remove_prefix(head_pos_);
+                    if (!view.empty()) parts[count++] = view;
+                }
+                return count;
+            }
+
+            // Отмечает n байт отправленными. Последний собственный буфер не
+            // освобождается, а очищается, чтобы следующий ответ писался в ту же память
+            void consume(size_t n) {
+                while (!segments_.empty()) {
+                    size_t remaining = segments_.front().view().size() - head_pos_;
+                    if (n < remaining) {
+                        head_pos_ += n;
+                        return;
+                    }
+                    n -= remaining;
+                    head_pos_ = 0;
+                    Segment& front = segments_.front();
+                    if (segments_.size() == 1 && !front.is_external && front.owned.capacity() <= 64 * 1024) {
+                        front.owned.clear();
+                        return;
+                    }
+                    segments_.pop_front();
+                }
+            }
+
+            void clear() {
+                segments_.clear();
+                head_pos_ = 0;
+            }
+
+        private:
+            struct Segment {
+                std::string owned;
+                std::shared_ptr<const void> shared;  // владелец external, если он разделяемый
+                std::string_view external;
+                bool is_external = false;
+
+                std::string_view view() const {
+                    return is_external ? external : std::string_view(owned);
+                }
+            };
+
+            std::deque<Segment> segments_;
+            size_t head_pos_ = 0;  // отправленная часть первого сегмента
+        };
+
+        // Одна попытка отправить накопленные сегменты одним системным вызовом.
+        // Возвращает число отправленных байт или -1 (причина в errno / WSAGetLastError)
+        inline long send_some(socket_t sock, OutputQueue& out) {
+            std::string_view parts[OutputQueue::max_iov];
+            int count = out.peek(parts, OutputQueue::max_iov);
+            if (count == 0) return 0;
+#ifdef _WIN32
+            WSABUF buffers[OutputQueue::max_iov];
+            for (int i = 0; i < count; i++) {
+                buffers[i].buf = const_cast<char*>(parts[i].data());
+                buffers[i].len = (ULONG)parts[i].size();
+            }
+            DWORD sent = 0;
+            if (WSASend(sock, buffers, count, &sent, 0, nullptr, nullptr) != 0) return -1;
+            long n = (long)sent;
+#else
+            iovec iov[OutputQueue::max_iov];
+            for (int i = 0; i < count; i++) {
+                iov[i].iov_base = const_cast<char*>(parts[i].data());
+                iov[i].iov_len = parts[i].size();
+            }
+            msghdr msg{};
+            msg.msg_iov = iov;
+            msg.msg_iovlen = count;
+#ifdef MSG_NOSIGNAL
+            long n = (long)sendmsg(sock, &msg, MSG_NOSIGNAL);
+#else
+            long n = (long)sendmsg(sock, &msg, 0);
+#endif
+#endif
+            if (n > 0) out.consume((size_t)n);
+            return n;
+        }
+
+        enum class Encoding { Identity, Gzip, Deflate };
+
+        inline const char* encoding_name(Encoding encoding) {
+            return encoding == Encoding::Gzip ? "gzip" : encoding == Encoding::Deflate ? "deflate" : "identity";
+        }
+
+        // Стоит ли сжимать тело такого типа: текст и JSON сжимаются в разы.
+        // События SSE не сжимаются - каждое должно уходить клиенту сразу
+        inline bool compressible(std::string_view content_type) {
+            if (content_type.substr(0, 17) == "text/event-stream") return false;
+            return content_type.substr(0, 5) == "text/" ||
+                content_type.substr(0, 16) == "application/json" ||
+                content_type.substr(0, 22) == "application/javascript" ||
+                content_type.substr(0, 15) == "application/xml" ||
+                content_type.substr(0, 13) == "image/svg+xml";
+        }
+
+        // Выбирает кодировку по Accept-Encoding: gzip предпочтительнее deflate,
+        // "*" разрешает любую, q=0 запрещает
+        inline Encoding negotiate_encoding(std::string_view header) {
+            bool gzip = false;
+            bool deflate = false;
+            bool any = false;
+            bool gzip_refused = false;
+            bool deflate_refused = false;
+            while (!header.empty()) {
+                size_t comma = header.find(',');
+                std::string_view item = header.substr(0, comma);
+                header = comma == std::string_view::npos ? std::string_view() : header.substr(comma + 1);
+
+                std::string_view params;
+                size_t semicolon = item.find(';');
+                if (semicolon != std::string_view::npos) {
+                    params = item.substr(semicolon + 1);
+                    item = item.substr(0, semicolon);
+                }
+                while (!item.empty() && item.front() == ' ') item.remove_prefix(1);
+                while (!item.empty() && item.back() == ' ') item.remove_suffix(1);
+
+                // q=0, q=0.0, q=0.000 - кодировка запрещена
+                bool refused = false;
+                size_t q = params.find("q=");
+                if (q != std::string_view::npos) {
+                    std::string_view value = params.substr(q + 2);
+                    refused = !value.empty() && value.find_first_not_of("0.") != 0;
+                    for (char c : value) {
+                        if (c >= '1' && c <= '9') refused = false;
+                        if (c == ' ' || c == ';') break;
+                    }
+                }
+
+                if (iequals(item, "gzip") || iequals(item, "x-gzip")) (refused ? gzip_refused : gzip) = true;
+                else if (iequals(item, "deflate")) (refused ? deflate_refused : deflate) = true;
+                else if (item == "*" && !refused) any = true;
+            }
+            if ((gzip || any) && !gzip_refused) return Encoding::Gzip;
+            if ((deflate || any) && !deflate_refused) return Encoding::Deflate;
+            return Encoding::Identity;
+        }
+
+#ifdef CPPHTTPLIB_ZLIB_SUPPORT
+        // Поток сжатия zlib: gzip или deflate (формат zlib, как требует HTTP)
+        class Compressor {
+        public:
+            explicit Compressor(Encoding encoding) {
+                int window_bits = encoding == Encoding::Gzip ? 15 + 16 : 15;
+                ok_ = deflateInit2(&strm_, CPPHTTPLIB_COMPRESSION_LEVEL, Z_DEFLATED, window_bits, 8,
+                    Z_DEFAULT_STRATEGY) == Z_OK;
+            }
+
+            ~Compressor() {
+                if (ok_) deflateEnd(&strm_);
+            }
+
+            Compressor(const Compressor&) = delete;
+            Compressor& operator=(const Compressor&) = delete;
+
+            // Дописывает сжатые данные в out. flush: Z_NO_FLUSH, Z_SYNC_FLUSH
+            // (все отданное уже можно распаковать) или Z_FINISH (конец потока)
+            template <typename String>
+            bool compress(std::string_view data, int flush, String& out) {
+                if (!ok_) return false;
+                strm_.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data.data()));
+                strm_.avail_in = (uInt)data.size();
+                // Для всего тела сразу хватает одного прохода с запасом deflateBound
+                size_t step = std::max<size_t>(deflateBound(&strm_, (uLong)data.size()), 64);
+                do {
+                    size_t pos = out.size();
+                    out.resize(pos + step);
+                    strm_.next_out = reinterpret_cast<Bytef*>(&out[pos]);
+                    strm_.avail_out = (uInt)step;
+                    int result = deflate(&strm_, flush);
+                    out.resize(pos + step - strm_.avail_out);
+                    if (result == Z_STREAM_ERROR) return false;
+                } while (strm_.avail_out == 0);
+                return true;
+            }
+
+        private:
+            z_stream strm_{};
+            bool ok_ = false;
+        };
+
+        // Сжатые копии общих неизменяемых тел (статические страницы, кэшированные
+        // списки): каждое сжимается один раз, пока жив владелец исходного тела.
+        // Владелец сравнивается по блоку управления weak_ptr, поэтому объект,
+        // занявший адрес освобожденного, не получит чужую копию
+        class CompressionCache {
+        public:
+            std::shared_ptr<const std::string> find(const std::shared_ptr<const void>& owner,
+                std::string_view data, Encoding encoding) {
+                std::lock_guard<std::mutex> lock(mtx_);
+                for (const Entry& entry : entries_) {
+                    if (entry.data == data.data() && entry.size == data.size() && entry.encoding == encoding &&
+                        !entry.owner.owner_before(owner) && !owner.owner_before(entry.owner)) {
+                        return entry.compressed;
+                    }
+                }
+                return nullptr;
+            }
+
+            void insert(const std::shared_ptr<const void>& owner, std::string_view data, Encoding encoding,
+                std::shared_ptr<const std::string> compressed) {
+                std::lock_guard<std::mutex> lock(mtx_);
+                Entry entry{ owner, data.data(), data.size(), encoding, std::move(compressed) };
+                // Сначала занимаем записи, владельцы которых уже освобождены
+                for (Entry& slot : entries_) {
+                    if (slot.owner.expired()) {
+                        slot = std::move(entry);
+                        return;
+                    }
+                }
+                if (entries_.size() < capacity) entries_.push_back(std::move(entry));
+                else entries_[next_++ % capacity] = std::move(entry);
+            }
+
+        private:
+            static constexpr size_t capacity = 64;
+
+            struct Entry {
+                std::weak_ptr<const void> owner;
+                const char* data;
+                size_t size;
+                Encoding encoding;
+                std::shared_ptr<const std::string> compressed;
+            };
+
+            std::mutex mtx_;
+            std::vector<Entry> entries_;
+            size_t next_ = 0;
+        };
+#endif
+
+        enum class StreamResult { Continue, Done, Error };
+
+        // Дописывает в очередь очередную порцию потокового ответа (с chunked-разметкой)
+        using StreamFn = std::function<StreamResult(OutputQueue& queue)>;
+
+        // Результат Continue без новых данных означает, что провайдер ждет wake.
+        // При сжатии каждая порция сбрасывается Z_SYNC_FLUSH: клиент может
+        // распаковать ее, не дожидаясь конца ответа
+        inline StreamFn make_chunked_stream(ContentProviderWithoutLength provider, std::function<void()> wake,
+            Encoding encoding = Encoding::Identity) {
+            size_t offset = 0;
+            DataSink sink;
+            sink.wake = std::move(wake);
+#ifdef CPPHTTPLIB_ZLIB_SUPPORT
+            std::shared_ptr<Compressor> compressor;
+            if (encoding != Encoding::Identity) compressor = std::make_shared<Compressor>(encoding);
+            std::string plain;  // порция провайдера до сжатия
+#else
+            (void)encoding;
+#endif
+            return [=, provider = std::move(provider)](OutputQueue& queue) mutable {
+                std::string& out = queue.tail();
+                size_t header_pos = out.size();
+                out.append(18, ' ');  // место под размер чанка
+                size_t data_pos = out.size();
+
+                bool finished = false;
+                std::string* target = &out;
+#ifdef CPPHTTPLIB_ZLIB_SUPPORT
+                if (compressor) {
+                    plain.clear();
+                    target = &plain;
+                }
+#endif
+                sink.write = [target](const char* data, size_t length) {
+                    target->append(data, length);
+                    return true;
+                };
+                sink.done = [&finished]() { finished = true; };
+                if (!provider(offset, sink)) return StreamResult::Error;
+#ifdef CPPHTTPLIB_ZLIB_SUPPORT
+                if (compressor) {
+                    offset += plain.size();
+                    if ((!plain.empty() || finished) &&
+                        !compressor->compress(plain, finished ? Z_FINISH : Z_SYNC_FLUSH, out)) {
+                        return StreamResult::Error;
+                    }
+                }
+                else {
+                    offset += out.size() - data_pos;
+                }
+#else
+                offset += out.size() - data_pos;
+#endif
+
+                size_t length = out.size() - data_pos;
+                if (length == 0) {
+                    out.resize(header_pos);
+                }
+                else {
+                    char size_line[19];
+                    int n = snprintf(size_line, sizeof(size_line), "%zx\r\n", length);
+                    out.replace(header_pos, 18, size_line, n);
+                    out += "\r\n";
+                }
+                if (finished) {
+                    out += "0\r\n\r\n";
+                    return StreamResult::Done;
+                }
+                return StreamResult::Continue;
+            };
+        }
+
+        inline const char* status_message(int status) {
+            switch (status) {
+            case 100: return "Continue";
+            case 200: return "OK";
+            case 201: return "Created";
+            case 202: return "Accepted";
+            case 204: return "No Content";
+            case 206: return "Partial Content";
+            case 301: return "Moved Permanently";
+            case 302: return "Found";
+            case 304: return "Not Modified";
+            case 307: return "Temporary Redirect";
+            case 308: return "Permanent Redirect";
+            case 400: return "Bad Request";
+            case 401: return "Unauthorized";
+            case 403: return "Forbidden";
+            case 404: return "Not Found";
+            case 405: return "Method Not Allowed";
+            case 408: return "Request Timeout";
+            case 409: return "Conflict";
+            case 410: return "Gone";
+            case 412: return "Precondition Failed";
+            case 413: return "Payload Too Large";
+            case 415: return "Unsupported Media Type";
+            case 422: return "Unprocessable Entity";
+            case 429: return "Too Many Requests";
+            case 431: return "Request Header Fields Too Large";
+            case 500: return "Internal Server Error";
+            case 501: return "Not Implemented";
+            case 502: return "Bad Gateway";
+            case 503: return "Service Unavailable";
+            case 504: return "Gateway Timeout";
+            // Фраза необязательна для клиента, но не должна выдавать ошибку за успех
+            default: return "Unknown";
+            }
+        }
+
+        // Готовая строка статуса "HTTP/1.1 200 OK\r\n"; строки собираются один раз
+        inline std::string_view status_line(int status) {
+            static const std::vector<std::string> lines = []() {
+                std::vector<std::string> table(600);
+                for (int code = 100; code < 600; code++) {
+                    table[code] = "HTTP/1.1 " + std::to_string(code) + " " + status_message(code) + "\r\n";
+                }
+                return table;
+            }();
+            if (status >= 100 && status < 600) return lines[status];
+            return lines[500];
+        }
+
+        struct ParserLimits {
+            size_t header_max_length = CPPHTTPLIB_HEADER_MAX_LENGTH;
+            size_t header_max_count = CPPHTTPLIB_HEADER_MAX_COUNT;
+            size_t payload_max_length = CPPHTTPLIB_PAYLOAD_MAX_LENGTH;
+        };
+
+        // Потоковый разбор HTTP запроса без копирования. Работает поверх растущего
+        // буфера соединения: каждый вызов parse() продолжает с того места, где
+        // остановился предыдущий. Все позиции хранятся как смещения, поэтому буфер
+        // может перераспределяться между вызовами. Тело с chunked-кодированием
+        // склеивается на месте, поверх заголовков чанков.
+        class RequestParser {
+        public:
+            enum class Result { Incomplete, Complete, Error };
+
+            explicit RequestParser(ParserLimits limits = ParserLimits()) : limits_(limits) {}
+
+            void set_limits(const ParserLimits& limits) {
+                limits_ = limits;
+            }
+
+            // Начинает разбор следующего запроса с позиции begin буфера
+            void reset(size_t begin = 0) {
+                state_ = State::RequestLine;
+                begin_ = begin;
+                scan_ = 0;
+                search_ = 0;
+                headers_.clear();
+                content_length_ = 0;
+                chunk_remaining_ = 0;
+                body_len_ = 0;
+                end_ = 0;
+                error_status_ = 0;
+                expect_continue_ = false;
+            }
+
+            // Сдвигает позиции после удаления prefix байт из начала буфера
+            void rebase(size_t prefix) {
+                begin_ -= prefix;
+            }
+
+            Result parse(std::string& buf) {
+                while (state_ != State::Done) {
+                    size_t available = buf.size() - begin_;
+                    char* base = &buf[0] + begin_;
+
+                    switch (state_) {
+                    case State::RequestLine:
+                    case State::Header:
+                    case State::ChunkSize:
+                    case State::Trailer: {
+                        // Поиск конца строки продолжается с места предыдущей попытки
+                        size_t eol = find_crlf(base, available, std::max(scan_, search_));
+                        size_t limit = state_ == State::ChunkSize ? 1024 : limits_.header_max_length;
+                        if (eol == npos) {
+                            if (available - scan_ > limit) return fail(431);
+                            search_ = available > 0 ? available - 1 : 0;
+                            return Result::Incomplete;
+                        }
+                        if (eol - scan_ > limit) return fail(431);
+                        if (!on_line(base, scan_, eol)) return Result::Error;
+                        scan_ = eol + 2;
+                        break;
+                    }
+                    case State::Body:
+                        if (available - body_off_ < content_length_) return Result::Incomplete;
+                        body_len_ = content_length_;
+                        end_ = body_off_ + content_length_;
+                        state_ = State::Done;
+                        break;
+                    case State::ChunkData:
+                        if (available - scan_ < chunk_remaining_ + 2) return Result::Incomplete;
+                        if (base[scan_ + chunk_remaining_] != '\r' || base[scan_ + chunk_remaining_ + 1] != '\n') {
+                            return fail(400);
+                        }
+                        std::memmove(base + body_off_ + body_len_, base + scan_, chunk_remaining_);
+                        body_len_ += chunk_remaining_;
+                        scan_ += chunk_remaining_ + 2;
+                        state_ = State::ChunkSize;
+                        break;
+                    case State::Done:
+                        break;
+                    }
+                }
+                return Result::Complete;
+            }
+
+            // Заполняет поля запроса ссылками в buf (после Result::Complete)
+            void fill(const std::string& buf, Request& req) const {
+                const char* base = buf.data() + begin_;
+                req.method = std::string_view(base + method_.first, method_.second);
+                req.target = std::string_view(base + target_.first, target_.second);
+                req.version = std::string_view(base + version_.first, version_.second);
+                req.path = req.target.substr(0, req.target.find('?'));
+                req.body = std::string_view(base + body_off_, body_len_);
+                req.headers.clear();
+                req.headers.reserve(headers_.size());
+                for (const auto& h : headers_) {
+                    req.headers.emplace_back(std::string_view(base + h.name_off, h.name_len),
+                        std::string_view(base + h.value_off, h.value_len));
+                }
+            }
+
+            // Сколько байт буфера (начиная с begin) занимает разобранный запрос
+            size_t consumed() const {
+                return end_;
+            }
+
+            size_t begin() const {
+                return begin_;
+            }
+
+            // Клиент ждет "100 Continue" перед отправкой тела
+            bool expects_continue() const {
+                return expect_continue_ && (state_ == State::Body || state_ == State::ChunkSize ||
+                    state_ == State::ChunkData);
+            }
+
+            void clear_expect_continue() {
+                expect_continue_ = false;
+            }
+
+            int error_status() const {
+                return error_status_;
+            }
+
+        private:
+            enum class State { RequestLine, Header, Body, ChunkSize, ChunkData, Trailer, Done };
+
+            struct HeaderPos {
+                size_t name_off, name_len, value_off, value_len;
+            };
+
+            static constexpr size_t npos = std::string::npos;
+
+            static size_t find_crlf(const char* base, size_t size, size_t from) {
+                for (size_t i = from; i + 1 < size; i++) {
+                    if (base[i] == '\r' && base[i + 1] == '\n') return i;
+                }
+                return npos;
+            }
+
+            Result fail(int status) {
+                error_status_ = status;
+                return Result::Error;
+            }
+
+            bool on_line(const char* base, size_t start, size_t eol) {
+                std::string_view line(base + start, eol - start);
+
+                switch (state_) {
+                case State::RequestLine: {
+                    // Допускаем пустые строки перед запросом (RFC 9112, 2.2)
+                    if (line.empty()) return true;
+                    size_t sp1 = line.find(' ');
+                    size_t sp2 = sp1 == npos ? npos : line.find(' ', sp1 + 1);
+                    if (sp1 == 0 || sp2 == npos || sp2 == sp1 + 1 ||
+                        line.substr(sp2 + 1).substr(0, 7) != "HTTP/1.") {
+                        fail(400);
+                        return false;
+                    }
+                    method_ = { start, sp1 };
+                    target_ = { start + sp1 + 1, sp2 - sp1 - 1 };
+                    version_ = { start + sp2 + 1, line.size() - sp2 - 1 };
+                    header_bytes_ = 0;
+                    state_ = State::Header;
+                    return true;
+                }
+                case State::Header: {
+                    header_bytes_ += line.size() + 2;
+                    if (header_bytes_ > limits_.header_max_length) {
+                        fail(431);
+                        return false;
+                    }
+                    if (line.empty()) return on_headers_end(base, eol + 2);
+                    if (headers_.size() >= limits_.header_max_count) {
+                        fail(431);
+                        return false;
+                    }
+
+                    size_t colon = line.find(':');
+                    if (colon == npos || colon == 0) {
+                        fail(400);
+                        return false;
+                    }
+                    size_t value_begin = colon + 1;
+                    size_t value_end = line.size();
+                    while (value_begin < value_end && (line[value_begin] == ' ' || line[value_begin] == '\t')) value_begin++;
+                    while (value_end > value_begin && (line[value_end - 1] == ' ' || line[value_end - 1] == '\t')) value_end--;
+                    headers_.push_back({ start, colon, start + value_begin, value_end - value_begin });
+                    return true;
+                }
+                case State::ChunkSize: {
+                    size_t size = 0;
+                    size_t digits = 0;
+                    for (char c : line) {
+                        int v;
+                        if (c >= '0' && c <= '9') v = c - '0';
+                        else if (c >= 'a' && c <= 'f') v = c - 'a' + 10;
+                        else if (c >= 'A' && c <= 'F') v = c - 'A' + 10;
+                        else break;  // расширения чанка после ';' игнорируем
+                        if (++digits > 15) {
+                            fail(413);
+                            return false;
+                        }
+                        size = size * 16 + v;
+                    }
+                    if (digits == 0) {
+                        fail(400);
+                        return false;
+                    }
+                    if (body_len_ + size > limits_.payload_max_length) {
+                        fail(413);
+                        return false;
+                    }
+                    if (size == 0) {
+                        state_ = State::Trailer;
+                    }
+                    else {
+                        chunk_remaining_ = size;
+                        state_ = State::ChunkData;
+                    }
+                    return true;
+                }
+                case State::Trailer:
+                    if (line.empty()) {
+                        end_ = eol + 2;
+                        state_ = State::Done;
+                    }
+                    return true;
+                default:
+                    return true;
+                }
+            }
+
+            bool on_headers_end(const char* base, size_t body_off) {
+                body_off_ = body_off;
+                std::string_view transfer_encoding, content_length, expect;
+
+                for (const auto& h : headers_) {
+                    std::string_view name(base + h.name_off, h.name_len);
+                    std::string_view value(base + h.value_off, h.value_len);
+                    if (iequals(name, "Transfer-Encoding")) transfer_encoding = value;
+                    else if (iequals(name, "Content-Length")) {
+                        if (!content_length.empty() && content_length != value) {
+                            fail(400);
+                            return false;
+                        }
+                        content_length = value;
+                    }
+                    else if (iequals(name, "Expect")) expect = value;
+                }
+                expect_continue_ = iequals(expect, "100-continue");
+
+                if (!transfer_encoding.empty()) {
+                    // Одновременно Transfer-Encoding и Content-Length - признак подмены запроса
+                    if (!content_length.empty()) {
+                        fail(400);
+                        return false;
+                    }
+                    if (!iequals(transfer_encoding, "chunked")) {
+                        fail(501);
+                        return false;
+                    }
+                    state_ = State::ChunkSize;
+                    return true;
+                }
+
+                content_length_ = 0;
+                if (!content_length.empty()) {
+                    for (char c : content_length) {
+                        if (c < '0' || c > '9' || content_length_ > limits_.payload_max_length) {
+                            fail(c < '0' || c > '9' ? 400 : 413);
+                            return false;
+                        }
+                        content_length_ = content_length_ * 10 + (c - '0');
+                    }
+                    if (content_length_ > limits_.payload_max_length) {
+                        fail(413);
+                        return false;
+                    }
+                }
+                state_ = State::Body;
+                return true;
+            }
+
+            ParserLimits limits_;
+            State state_ = State::RequestLine;
+            size_t begin_ = 0;
+            size_t scan_ = 0;
+            size_t search_ = 0;
+            size_t header_bytes_ = 0;
+            std::pair<size_t, size_t> method_, target_, version_;
+            std::vector<HeaderPos> headers_;
+            size_t content_length_ = 0;
+            size_t chunk_remaining_ = 0;
+            size_t body_off_ = 0;
+            size_t body_len_ = 0;
+            size_t end_ = 0;
+            int error_status_ = 0;
+            bool expect_continue_ = false;
+        };
+
+        // Монотонная память запроса: выделение - сдвиг указателя, освобождение
+        // отдельных блоков не делается, все сбрасывается одним release() после
+        // отправки ответа. Начальный буфер живет с соединением и переиспользуется
+        class RequestArena {
+        public:
+            RequestArena()
+                : buffer_(new char[CPPHTTPLIB_REQUEST_ARENA_SIZE]),
+                resource_(buffer_.get(), CPPHTTPLIB_REQUEST_ARENA_SIZE, std::pmr::new_delete_resource()) {}
+
+            RequestArena(const RequestArena&) = delete;
+            RequestArena& operator=(const RequestArena&) = delete;
+
+            std::pmr::memory_resource* resource() {
+                return &resource_;
+            }
+
+            // Ничто, выделенное до вызова, больше не должно использоваться
+            void release() {
+                resource_.release();
+            }
+
+        private:
+            std::unique_ptr<char[]> buffer_;
+            std::pmr::monotonic_buffer_resource resource_;
+        };
+
+        // Состояние одного соединения: входной буфер, разбор, исходящие данные
+        struct Session {
+            std::string in;
+            RequestParser parser;
+            OutputQueue out;
+            StreamFn stream;  // незавершенный потоковый ответ
+            // Передается потоковому ответу как DataSink::wake
+            std::function<void()> waker;
+            uint32_t remote_addr = 0;
+            // Время последнего чтения из сокета - момент прихода запросов в in
+            std::chrono::steady_clock::time_point received_at;
+            // Запросы и ответы, обработанные за один вызов process_session; тела
+            // больших ответов отправляются прямо из нее
+            RequestArena arena;
+        };
+
+#ifdef CPPHTTPLIB_USE_EPOLL
+        inline void set_nonblocking(socket_t sock) {
+            int flags = fcntl(sock, F_GETFL, 0);
+            fcntl(sock, F_SETFL, flags | O_NONBLOCK);
+        }
+
+        // Один поток epoll, обслуживающий множество неблокирующих соединений
+        class EpollLoop {
+        public:
+            // Разбирает полные запросы из session.in и дописывает ответы в session.out
+            // (или запускает session.stream). Возвращает false, если после отправки
+            // ответа соединение нужно закрыть
+            using Processor = std::function<bool(Session& session)>;
+            // Решает судьбу соединения, принятого самим циклом: false - сервер
+            // уже отказал ему и закрыл сокет
+            using AcceptFilter = std::function<bool(socket_t fd)>;
+
+            // active_connections - общий для всех циклов счетчик открытых соединений
+            EpollLoop(Processor processor, int idle_timeout_sec, ParserLimits limits,
+                std::atomic<int64_t>& active_connections)
+                : processor_(std::move(processor)), idle_timeout_(idle_timeout_sec), limits_(limits),
+                active_connections_(active_connections) {}
+
+            EpollLoop(const EpollLoop&) = delete;
+            EpollLoop& operator=(const EpollLoop&) = delete;
+
+            ~EpollLoop() {
+                stop();
+            }
+
+            // Собственный слушающий сокет (SO_REUSEPORT): цикл сам принимает
+            // соединения, без общего потока accept. Вызывается до start()
+            void set_listener(socket_t fd, AcceptFilter filter) {
+                listen_fd_ = fd;
+                accept_filter_ = std::move(filter);
+            }
+
+            // cpu >= 0 - поток цикла закрепляется за этим ядром
+            bool start(int cpu = -1) {
+                epfd_ = epoll_create1(EPOLL_CLOEXEC);
+                wakeups_->fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+                if (epfd_ < 0 || wakeups_->fd < 0) {
+                    close_fds();
+                    return false;
+                }
+
+                epoll_event ev{};
+                ev.events = EPOLLIN;
+                ev.data.fd = wakeups_->fd;
+                if (epoll_ctl(epfd_, EPOLL_CTL_ADD, wakeups_->fd, &ev) < 0) {
+                    close_fds();
+                    return false;
+                }
+                if (listen_fd_ != invalid_socket) {
+                    set_nonblocking(listen_fd_);
+                    ev.data.fd = listen_fd_;
+                    if (epoll_ctl(epfd_, EPOLL_CTL_ADD, listen_fd_, &ev) < 0) {
+                        close_fds();
+                        return false;
+                    }
+                }
+
+                running_ = true;
+                thread_ = std::thread([this]() { run(); });
+                if (cpu >= 0) {
+                    cpu_set_t set;
+                    CPU_ZERO(&set);
+                    CPU_SET(cpu, &set);
+                    pthread_setaffinity_np(thread_.native_handle(), sizeof(set), &set);
+                }
+                return true;
+            }
+
+            void stop() {
+                if (!running_.exchange(false)) return;
+                wake();
+                if (thread_.joinable()) thread_.join();
+                for (auto& [fd, conn] : conns_) close_socket(fd);
+                active_connections_.fetch_sub((int64_t)conns_.size(), std::memory_order_relaxed);
+                conns_.clear();
+                close_fds();
+            }
+
+            // Передает принятое соединение этому циклу (потокобезопасно)
+            void add(socket_t fd, uint32_t remote_addr) {
+                {
+                    std::lock_guard<std::mutex> lock(pending_mtx_);
+                    pending_.emplace_back(fd, remote_addr);
+                }
+                wake();
+            }
+
+        private:
+            struct Connection {
+                socket_t fd;
+                uint64_t id;  // отличает соединение от следующего с тем же fd
+                Session session;
+                bool close_after_write = false;
+                bool peer_closed = false;
+                bool want_write = false;
+                bool parked = false;  // потоковый ответ ждет данных
+                uint32_t events = EPOLLIN | EPOLLRDHUP;  // текущая подписка в epoll
+                std::chrono::steady_clock::time_point last_active;
+            };
+
+            // Соединения, разбуженные из других потоков. Живет, пока есть
+            // хоть одна функция пробуждения, поэтому отдельно от цикла
+            struct Wakeups {
+                std::mutex mtx;
+                std::vector<std::pair<socket_t, uint64_t>> conns;
+                int fd = -1;
+                bool closed = false;
+
+                void post(socket_t conn_fd, uint64_t conn_id) {
+                    std::lock_guard<std::mutex> lock(mtx);
+                    if (closed) return;
+                    conns.emplace_back(conn_fd, conn_id);
+                    signal();
+                }
+
+                void signal() {
+                    uint64_t one = 1;
+                    ssize_t n = write(fd, &one, sizeof(one));
+                    (void)n;
+                }
+            };
+
+            void wake() {
+                std::lock_guard<std::mutex> lock(wakeups_->mtx);
+                if (!wakeups_->closed) wakeups_->signal();
+            }
+
+            // Закрывает epoll и eventfd - после остановки или неудачного start()
+            void close_fds() {
+                if (epfd_ >= 0) close(epfd_);
+                epfd_ = -1;
+                // Пробуждения потоковых ответов могут прийти и после остановки
+                std::lock_guard<std::mutex> lock(wakeups_->mtx);
+                wakeups_->closed = true;
+                if (wakeups_->fd >= 0) close(wakeups_->fd);
+                wakeups_->fd = -1;
+            }
+
+            void run() {
+                epoll_event events[256];
+                auto last_sweep = std::chrono::steady_clock::now();
+
+                while (running_) {
+                    int n = epoll_wait(epfd_, events, 256, 1000);
+                    for (int i = 0; i < n; i++) {
+                        int fd = events[i].data.fd;
+                        if (fd == wakeups_->fd) {
+                            uint64_t value;
+                            ssize_t r = read(wakeups_->fd, &value, sizeof(value));
+                            (void)r;
+                            register_pending();
+                            resume_woken();
+                            continue;
+                        }
+                        if (fd == listen_fd_) {
+                            accept_ready();
+                            continue;
+                        }
+
+                        auto it = conns_.find(fd);
+                        if (it == conns_.end()) continue;
+                        Connection& conn = *it->second;
+
+                        if (events[i].events & (EPOLLERR | EPOLLHUP)) {
+                            close_connection(fd);
+                            continue;
+                        }
+                        if ((events[i].events & EPOLLRDHUP) && conn.session.stream) {
+                            // Клиент ушел, не дождавшись конца потокового ответа
+                            close_connection(fd);
+                            continue;
+                        }
+                        if (events[i].events & (EPOLLIN | EPOLLRDHUP)) on_readable(conn);
+                        else if (events[i].events & EPOLLOUT) pump(conn);
+                    }
+
+                    auto now = std::chrono::steady_clock::now();
+                    if (now - last_sweep >= std::chrono::seconds(1)) {
+                        sweep_idle(now);
+                        last_sweep = now;
+                    }
+                }
+            }
+
+            void register_pending() {
+                std::vector<std::pair<socket_t, uint32_t>> fds;
+                {
+                    std::lock_guard<std::mutex> lock(pending_mtx_);
+                    fds.swap(pending_);
+                }
+                for (auto [fd, remote_addr] : fds) {
+                    set_nonblocking(fd);
+                    register_connection(fd, remote_addr);
+                }
+            }
+
+            // Принимает все ожидающие соединения своего слушающего сокета
+            void accept_ready() {
+                for (;;) {
+                    sockaddr_in client_addr;
+                    socklen_t addrlen = sizeof(client_addr);
+                    socket_t fd = accept4(listen_fd_, (sockaddr*)&client_addr, &addrlen, SOCK_NONBLOCK | SOCK_CLOEXEC);
+                    if (fd == invalid_socket) {
+                        if (errno == EINTR || errno == ECONNABORTED) continue;
+                        return;  // EAGAIN - очередь пуста; EMFILE и т.п. - повторим по следующему событию
+                    }
+                    if (accept_filter_ && !accept_filter_(fd)) continue;
+                    register_connection(fd, client_addr.sin_addr.s_addr);
+                }
+            }
+
+            void register_connection(socket_t fd, uint32_t remote_addr) {
+                int opt = 1;
+                setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &opt, sizeof(opt));
+
+                epoll_event ev{};
+                ev.events = EPOLLIN | EPOLLRDHUP;
+                ev.data.fd = fd;
+                if (epoll_ctl(epfd_, EPOLL_CTL_ADD, fd, &ev) < 0) {
+                    close_socket(fd);
+                    return;
+                }
+
+                auto conn = std::make_unique<Connection>();
+                conn->fd = fd;
+                conn->id = next_conn_id_++;
+                conn->session.parser.set_limits(limits_);
+                conn->session.remote_addr = remote_addr;
+                conn->session.waker = [wakeups = wakeups_, fd, id = conn->id]() { wakeups->post(fd, id); };
+                conn->last_active = std::chrono::steady_clock::now();
+                conns_[fd] = std::move(conn);
+                active_connections_.fetch_add(1, std::memory_order_relaxed);
+            }
+
+            // Больше этого в буфере не бывает у корректного клиента: один запрос
+            // с заголовками и телом предельного размера
+            size_t input_limit() const {
+                return limits_.header_max_length + limits_.payload_max_length;
+            }
+
+            // Читать сокет стоит, только если прочитанное будет разобрано: во
+            // время потокового ответа разбор стоит, а переполненный буфер сначала
+            // должен освободиться. Иначе клиент, шлющий без остановки, раздувает
+            // буфер без ограничения; пусть данные ждут в сокете
+            bool wants_input(const Connection& conn) const {
+                return !conn.peer_closed && !conn.session.stream && conn.session.in.size() < input_limit();
+            }
+
+            void on_readable(Connection& conn) {
+                char buffer[16384];
+                while (conn.session.in.size() < input_limit()) {
+                    ssize_t n = recv(conn.fd, buffer, sizeof(buffer), 0);
+                    if (n > 0) {
+                        conn.session.in.append(buffer, n);
+                        conn.session.received_at = std::chrono::steady_clock::now();
+                        continue;
+                    }
+                    if (n == 0) {
+                        // Клиент закрыл свою сторону: дописываем ответы и закрываем
+                        conn.peer_closed = true;
+                        break;
+                    }
+                    if (errno == EINTR) continue;
+                    if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+                    close_connection(conn.fd);
+                    return;
+                }
+                conn.last_active = std::chrono::steady_clock::now();
+                pump(conn);
+            }
+
+            // Отправляет исходящие данные, подкачивает потоковый ответ и обрабатывает
+            // следующие конвейерные запросы, пока сокет принимает данные
+            void pump(Connection& conn) {
+                if (advance(conn)) update_events(conn);
+            }
+
+            // Возвращает false, если соединение закрыто
+            bool advance(Connection& conn) {
+                Session& session = conn.session;
+                for (;;) {
+                    if (!flush(conn)) return false;
+                    if (!session.out.empty()) return true;  // ждем EPOLLOUT
+
+                    if (session.stream) {
+                        conn.parked = false;
+                        auto result = session.stream(session.out);
+                        if (result == StreamResult::Error) {
+                            close_connection(conn.fd);
+                            return false;
+                        }
+                        if (result == StreamResult::Done) session.stream = nullptr;
+                        else if (session.out.empty()) {
+                            // Новых данных пока нет: ждем wake или повтора в sweep
+                            conn.parked = true;
+                            return true;
+                        }
+                        continue;
+                    }
+
+                    // Конвейерные запросы обрабатываются по порядку
+                    if (!conn.close_after_write && !session.in.empty()) {
+                        if (!processor_(session)) conn.close_after_write = true;
+                        if (!session.out.empty() || session.stream) continue;
+                    }
+                    if (conn.close_after_write || conn.peer_closed) {
+                        close_connection(conn.fd);
+                        return false;
+                    }
+                    return true;
+                }
+            }
+
+            // Возвращает false, если соединение было закрыто из-за ошибки
+            bool flush(Connection& conn) {
+                OutputQueue& out = conn.session.out;
+                bool sent = false;
+                while (!out.empty()) {
+                    long n = send_some(conn.fd, out);
+                    if (n > 0) {
+                        sent = true;
+                        continue;
+                    }
+                    if (n < 0 && errno == EINTR) continue;
+                    if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                        conn.want_write = true;
+                        return true;
+                    }
+                    close_connection(conn.fd);
+                    return false;
+                }
+
+                if (sent) conn.last_active = std::chrono::steady_clock::now();
+                conn.want_write = false;
+                return true;
+            }
+
+            // Приводит подписку epoll в соответствие с состоянием соединения.
+            // Во время потокового ответа чтение стоит, но EPOLLRDHUP остается:
+            // ждущий подписчик, закрывший соединение, не должен держать его до
+            // следующей порции данных
+            void update_events(Connection& conn) {
+                uint32_t events = 0;
+                if (wants_input(conn)) events = EPOLLIN | EPOLLRDHUP;
+                else if (!conn.peer_closed && conn.session.stream) events = EPOLLRDHUP;
+                if (conn.want_write) events |= EPOLLOUT;
+                if (events == conn.events) return;
+                conn.events = events;
+                epoll_event ev{};
+                ev.events = events;
+                ev.data.fd = conn.fd;
+                epoll_ctl(epfd_, EPOLL_CTL_MOD, conn.fd, &ev);
+            }
+
+            void close_connection(socket_t fd) {
+                epoll_ctl(epfd_, EPOLL_CTL_DEL, fd, nullptr);
+                close_socket(fd);
+                if (conns_.erase(fd)) active_connections_.fetch_sub(1, std::memory_order_relaxed);
+            }
+
+            void resume_woken() {
+                std::vector<std::pair<socket_t, uint64_t>> woken;
+                {
+                    std::lock_guard<std::mutex> lock(wakeups_->mtx);
+                    woken.swap(wakeups_->conns);
+                }
+                for (auto [fd, id] : woken) {
+                    auto it = conns_.find(fd);
+                    // Соединение могло закрыться, а fd - достаться новому
+                    if (it == conns_.end() || it->second->id != id || !it->second->parked) continue;
+                    pump(*it->second);
+                }
+            }
+
+            // Закрывает простаивающие соединения; ждущие потоковые ответы не
+            // простаивают - их провайдеры вызываются повторно
+            void sweep_idle(std::chrono::steady_clock::time_point now) {
+                std::vector<socket_t> expired;
+                std::vector<socket_t> parked;
+                for (auto& [fd, conn] : conns_) {
+                    if (conn->parked) parked.push_back(fd);
+                    else if (now - conn->last_active >= idle_timeout_) expired.push_back(fd);
+                }
+                for (socket_t fd : expired) close_connection(fd);
+                for (socket_t fd : parked) {
+                    auto it = conns_.find(fd);
+                    if (it != conns_.end() && it->second->parked) pump(*it->second);
+                }
+            }
+
+            Processor processor_;
+            std::chrono::seconds idle_timeout_;
+            ParserLimits limits_;
+            std::atomic<int64_t>& active_connections_;
+            int epfd_ = -1;
+            socket_t listen_fd_ = invalid_socket;
+            AcceptFilter accept_filter_;
+            std::shared_ptr<Wakeups> wakeups_ = std::make_shared<Wakeups>();
+            uint64_t next_conn_id_ = 1;
+            std::unordered_map<socket_t, std::unique_ptr<Connection>> conns_;
+            std::mutex pending_mtx_;
+            std::vector<std::pair<socket_t, uint32_t>> pending_;
+            std::atomic<bool> running_{ false };
+            std::thread thread_;
+        };
+#endif
+
+    } // namespace detail
+
+    // Пул потоков с ограниченной очередью заданий
+    class ThreadPool {
+    public:
+        using Job = std::function<void()>;
+
+        ThreadPool(size_t thread_count, size_t max_queued)
+            : max_queued_(max_queued) {
+            if (thread_count == 0) {
+                thread_count = std::max(1u, std::thread::hardware_concurrency());
+            }
+            threads_.reserve(thread_count);
+            for (size_t i = 0; i < thread_count; i++) {
+                threads_.emplace_back([this]() { worker(); });
+            }
+        }
+
+        ThreadPool(const ThreadPool&) = delete;
+        ThreadPool& operator=(const ThreadPool&) = delete;
+
+        ~ThreadPool() {
+            shutdown();
+        }
+
+        // Возвращает false, если очередь заполнена (вызывающий должен отказать клиенту)
+        bool enqueue(Job job) {
+            {
+                std::lock_guard<std::mutex> lock(mtx_);
+                if (shutdown_ || jobs_.size() >= max_queued_) return false;
+                jobs_.push_back(std::move(job));
+            }
+            cv_.notify_one();
+            return true;
+        }
+
+        // Дожидается выполнения уже поставленных заданий и останавливает потоки
+        void shutdown() {
+            {
+                std::lock_guard<std::mutex> lock(mtx_);
+                if (shutdown_) return;
+                shutdown_ = true;
+            }
+            cv_.notify_all();
+            for (auto& t : threads_) {
+                if (t.joinable()) t.join();
+            }
+        }
+
+    private:
+        void worker() {
+            for (;;) {
+                Job job;
+                {
+                    std::unique_lock<std::mutex> lock(mtx_);
+                    cv_.wait(lock, [this] { return !jobs_.empty() || shutdown_; });
+                    if (jobs_.empty()) return;
+                    job = std::move(jobs_.front());
+                    jobs_.pop_front();
+                }
+                job();
+            }
+        }
+
+        std::vector<std::thread> threads_;
+        std::deque<Job> jobs_;
+        size_t max_queued_;
+        bool shutdown_ = false;
+        std::mutex mtx_;
+        std::condition_variable cv_;
+    };
+
+    using Handler = std::function<void(const Request&, Response&)>;
+
+    namespace detail {
+
+        enum class Method { Get, Post, Put, Patch, Delete, Count };
+
+        inline const char* method_name(Method method) {
+            static const char* const names[] = { "GET", "POST", "PUT", "PATCH", "DELETE" };
+            return names[(size_t)method];
+        }
+
+        inline bool method_from_string(std::string_view s, Method& method) {
+            if (s == "GET") method = Method::Get;
+            else if (s == "POST") method = Method::Post;
+            else if (s == "PUT") method = Method::Put;
+            else if (s == "PATCH") method = Method::Patch;
+            else if (s == "DELETE") method = Method::Delete;
+            else return false;
+            return true;
+        }
+
+        // Дерево маршрутов по сегментам пути. Шаблоны разбираются один раз
+        // при регистрации: "/tasks/{id:int}" - статический сегмент и параметр из цифр,
+        // "{name}" - параметр из любого непустого сегмента.
+        class Router {
+        public:
+            // route_id - номер маршрута для метрик (0 зарезервирован за ненайденными)
+            void add(Method method, const std::string& pattern, Handler handler, size_t route_id) {
+                Node* node = &root_;
+                for_each_segment(pattern, [&node](std::string_view segment) {
+                    if (segment.size() >= 2 && segment.front() == '{' && segment.back() == '}') {
+                        std::string_view name = segment.substr(1, segment.size() - 2);
+                        bool digits = false;
+                        size_t colon = name.find(':');
+                        if (colon != std::string_view::npos) {
+                            digits = name.substr(colon + 1) == "int";
+                            name = name.substr(0, colon);
+                        }
+                        if (!node->param) {
+                            node->param = std::make_unique<Node>();
+                            node->param_name = std::string(name);
+                            node->param_digits = digits;
+                        }
+                        node = node->param.get();
+                        return;
+                    }
+
+                    for (auto& [text, child] : node->children) {
+                        if (text == segment) {
+                            node = child.get();
+                            return;
+                        }
+                    }
+                    node->children.emplace_back(std::string(segment), std::make_unique<Node>());
+                    node = node->children.back().second.get();
+                });
+                node->handlers[(size_t)method] = std::move(handler);
+                node->route_ids[(size_t)method] = route_id;
+            }
+
+            // Находит обработчик для метода и пути, параметры пишет в req.path_params,
+            // номер маршрута - в route_id (0, если обработчика нет)
+            const Handler* match(Method method, Request& req, size_t& route_id) const {
+                route_id = 0;
+                std::string_view segments[max_segments];
+                size_t count = 0;
+                bool too_long = false;
+                for_each_segment(req.path, [&](std::string_view segment) {
+                    if (count == max_segments) too_long = true;
+                    else segments[count++] = segment;
+                });
+                if (too_long) return nullptr;
+
+                req.path_params.clear();
+                const Node* node = find(&root_, segments, count, 0, req.path_params);
+                if (!node) return nullptr;
+                const Handler& handler = node->handlers[(size_t)method];
+                if (!handler) return nullptr;
+                route_id = node->route_ids[(size_t)method];
+                return &handler;
+            }
+
+        private:
+            static constexpr size_t max_segments = 16;
+
+            struct Node {
+                std::vector<std::pair<std::string, std::unique_ptr<Node>>> children;
+                std::unique_ptr<Node> param;
+                std::string param_name;
+                bool param_digits = false;
+                Handler handlers[(size_t)Method::Count];
+                size_t route_ids[(size_t)Method::Count] = {};
+            };
+
+            template <typename Fn>
+            static void for_each_segment(std::string_view path, Fn fn) {
+                if (!path.empty() && path.front() == '/') path.remove_prefix(1);
+                if (path.empty()) return;
+                for (;;) {
+                    size_t slash = path.find('/');
+                    fn(path.substr(0, slash));
+                    if (slash == std::string_view::npos) break;
+                    path.remove_prefix(slash + 1);
+                }
+            }
+
+            static bool is_digits(std::string_view s) {
+                if (s.empty()) return false;
+                for (char c : s) {
+                    if (c < '0' || c > '9') return false;
+                }
+                return true;
+            }
+
+            // Статические сегменты имеют приоритет над параметрами
+            static const Node* find(const Node* node, const std::string_view* segments, size_t count,
+                size_t index, Params& params) {
+                if (index == count) return node;
+                std::string_view segment = segments[index];
+
+                for (const auto& [text, child] : node->children) {
+                    if (text == segment) {
+                        if (const Node* found = find(child.get(), segments, count, index + 1, params)) return found;
+                        break;
+                    }
+                }
+
+                if (node->param && !segment.empty() && (!node->param_digits || is_digits(segment))) {
+                    params.emplace_back(node->param_name, segment);
+                    if (const Node* found = find(node->param.get(), segments, count, index + 1, params)) return found;
+                    params.pop_back();
+                }
+                return nullptr;
+            }
+
+            Node root_;
+        };
+
+        // Ограничение частоты запросов с одного IPv4-адреса (token bucket): у адреса
+        // корзина на burst токенов, пополняемая со скоростью rate в секунду, каждый
+        // запрос забирает токен. Корзины разложены по шардам со своими мьютексами.
+        // Полная корзина ничем не отличается от отсутствующей, поэтому такие
+        // корзины удаляются, когда таблица шарда вырастает вдвое
+        class RateLimiter {
+        public:
+            // rate <= 0 выключает ограничение
+            void configure(double rate, double burst) {
+                rate_ = rate;
+                burst_ = std::max(burst, 1.0);
+            }
+
+            bool enabled() const { return rate_ > 0; }
+
+            // false - токенов нет; retry_after - через сколько секунд появится следующий
+            bool acquire(uint32_t addr, std::chrono::steady_clock::time_point now, double& retry_after) {
+                Shard& shard = shards_[(addr * 2654435761u) >> (32 - shard_bits)];
+                std::lock_guard<std::mutex> lock(shard.mtx);
+                auto it = shard.buckets.find(addr);
+                if (it == shard.buckets.end()) {
+                    if (shard.buckets.size() >= shard.sweep_at) sweep(shard, now);
+                    it = shard.buckets.emplace(addr, Bucket{ burst_, now }).first;
+                }
+                Bucket& bucket = it->second;
+                refill(bucket, now);
+                if (bucket.tokens >= 1) {
+                    bucket.tokens -= 1;
+                    return true;
+                }
+                retry_after = (1 - bucket.tokens) / rate_;
+                return false;
+            }
+
+        private:
+            static constexpr size_t shard_bits = 6;
+            static constexpr size_t min_sweep = 1024;
+
+            struct Bucket {
+                double tokens;
+                std::chrono::steady_clock::time_point updated;
+            };
+
+            struct alignas(64) Shard {
+                std::mutex mtx;
+                std::unordered_map<uint32_t, Bucket> buckets;
+                size_t sweep_at = min_sweep;
+            };
+
+            void refill(Bucket& bucket, std::chrono::steady_clock::time_point now) const {
+                // Потоки берут время до блокировки, поэтому оно может идти назад
+                if (now <= bucket.updated) return;
+                double elapsed = std::chrono::duration<double>(now - bucket.updated).count();
+                bucket.tokens = std::min(burst_, bucket.tokens + elapsed * rate_);
+                bucket.updated = now;
+            }
+
+            void sweep(Shard& shard, std::chrono::steady_clock::time_point now) {
+                for (auto it = shard.buckets.begin(); it != shard.buckets.end();) {
+                    refill(it->second, now);
+                    if (it->second.tokens >= burst_) it = shard.buckets.erase(it);
+                    else ++it;
+                }
+                shard.sweep_at = std::max(min_sweep, shard.buckets.size() * 2);
+            }
+
+            double rate_ = 0;
+            double burst_ = 1;
+            Shard shards_[size_t(1) << shard_bits];
+        };
+
+        // Счетчики запросов и гистограммы задержек по маршрутам. Каждый поток
+        // пишет только в свой набор (обычные load/store, без блокировок и
+        // атомарных read-modify-write), чтение для /metrics суммирует наборы
+        class ServerMetrics {
+        public:
+            // Логарифмически-линейные корзины, как в HDR Histogram: до 4 мкс по 1 мкс,
+            // дальше по 4 корзины на степень двойки (погрешность до 25%), до ~2 минут
+            static constexpr size_t bucket_count = 104;
+            // Коды с отдельным счетчиком; остальные попадают в последний слот
+            static constexpr int known_statuses[] = {
+                100, 200, 201, 202, 204, 206, 301, 302, 304, 307, 308, 400, 401, 403, 404, 405,
+                408, 409, 410, 412, 413, 415, 422, 429, 431, 500, 501, 502, 503, 504,
+            };
+            static constexpr size_t status_slots = sizeof(known_statuses) / sizeof(int) + 1;
+
+            // Суммы по всем потокам на момент чтения
+            struct Totals {
+                std::vector<uint64_t> requests;  // [маршрут * status_slots + слот]
+                std::vector<uint64_t> buckets;   // [маршрут * bucket_count + корзина]
+                std::vector<uint64_t> sum_ns;    // [маршрут]
+            };
+
+            // Число маршрутов вместе с нулевым; наборы потоков, созданные раньше,
+            // новые маршруты не учитывают
+            void set_route_count(size_t count) {
+                route_count_.store(count, std::memory_order_relaxed);
+            }
+
+            size_t route_count() const {
+                return route_count_.load(std::memory_order_relaxed);
+            }
+
+            void record(size_t route, int status, std::chrono::steady_clock::duration latency) {
+                Shard* shard = local_shard();
+                if (route >= shard->routes) return;
+                bump(shard->requests[route * status_slots + status_slot(status)], 1);
+                uint64_t ns = (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(latency).count();
+                bump(shard->buckets[route * bucket_count + bucket_index(ns / 1000)], 1);
+                bump(shard->sum_ns[route], ns);
+            }
+
+            // Ответ без обработчика (ошибка разбора): только счетчик, без задержки
+            void record_status(size_t route, int status) {
+                Shard* shard = local_shard();
+                if (route >= shard->routes) return;
+                bump(shard->requests[route * status_slots + status_slot(status)], 1);
+            }
+
+            Totals collect() const {
+                size_t routes = route_count();
+                Totals totals;
+                totals.requests.assign(routes * status_slots, 0);
+                totals.buckets.assign(routes * bucket_count, 0);
+                totals.sum_ns.assign(routes, 0);
+
+                std::lock_guard<std::mutex> lock(shards_mtx_);
+                for (const auto& shard : shards_) {
+                    size_t n = std::min(routes, shard->routes);
+                    for (size_t i = 0; i < n * status_slots; i++) totals.requests[i] += load(shard->requests[i]);
+                    for (size_t i = 0; i < n * bucket_count; i++) totals.buckets[i] += load(shard->buckets[i]);
+                    for (size_t i = 0; i < n; i++) totals.sum_ns[i] += load(shard->sum_ns[i]);
+                }
+                return totals;
+            }
+
+            static int slot_status(size_t slot) {
+                return slot < status_slots - 1 ? known_statuses[slot] : 0;
+            }
+
+            // Верхняя граница корзины в микросекундах
+            static uint64_t bucket_upper_us(size_t index) {
+                if (index < 4) return index + 1;
+                size_t shift = (index - 4) / 4;
+                return (uint64_t)(5 + (index - 4) % 4) << shift;
+            }
+
+            std::atomic<int64_t> active_connections{ 0 };
+
+        private:
+            struct Shard {
+                explicit Shard(size_t routes)
+                    : routes(routes), requests(routes * status_slots), buckets(routes * bucket_count), sum_ns(routes) {}
+
+                size_t routes;
+                std::vector<std::atomic<uint64_t>> requests;
+                std::vector<std::atomic<uint64_t>> buckets;
+                std::vector<std::atomic<uint64_t>> sum_ns;
+            };
+
+            // Пишет только поток-владелец, поэтому хватает load + store
+            static void bump(std::atomic<uint64_t>& counter, uint64_t delta) {
+                counter.store(counter.load(std::memory_order_relaxed) + delta, std::memory_order_relaxed);
+            }
+
+            static uint64_t load(const std::atomic<uint64_t>& counter) {
+                return counter.load(std::memory_order_relaxed);
+            }
+
+            static size_t bucket_index(uint64_t us) {
+                if (us < 4) return (size_t)us;
+                size_t exponent = 63 - (size_t)count_leading_zeros(us);  // us >= 4, exponent >= 2
+                size_t index = 4 + (exponent - 2) * 4 + (size_t)((us >> (exponent - 2)) & 3);
+                return std::min(index, bucket_count - 1);
+            }
+
+            static int count_leading_zeros(uint64_t value) {
+#if defined(__GNUC__) || defined(__clang__)
+                return __builtin_clzll(value);
 #else
-    typedef int socket_t;
-    inline socket_t invalid_socket = -1;
+                int n = 0;
+                for (uint64_t bit = uint64_t(1) << 63; !(value & bit); bit >>= 1) n++;
+                return n;
 #endif
+            }
 
-    struct Request {
-        std::string method;
-        std::string path;
-        std::string body;
-        std::smatch matches;
-        std::map<std::string, std::string> headers;
-    };
+            static size_t status_slot(int status) {
+                static const auto table = []() {
+                    std::array<uint8_t, 600> t{};
+                    t.fill((uint8_t)(status_slots - 1));
+                    for (size_t i = 0; i < status_slots - 1; i++) t[known_statuses[i]] = (uint8_t)i;
+                    return t;
+                }();
+                return status >= 0 && status < 600 ? table[status] : status_slots - 1;
+            }
 
-    struct Response {
-        int status = 200;
-        std::string body;
-        std::map<std::string, std::string> headers;
+            // Набор текущего потока для этого экземпляра; создается при первой записи.
+            // Кэш хранит номер экземпляра, чтобы не взять набор удаленного сервера
+            Shard* local_shard() {
+                struct CacheEntry {
+                    uint64_t metrics_id;
+                    Shard* shard;
+                };
+                thread_local std::vector<CacheEntry> cache;
+                for (const CacheEntry& entry : cache) {
+                    if (entry.metrics_id == instance_id_) return entry.shard;
+                }
 
-        void set_content(const std::string& s, const std::string& content_type) {
-            body = s;
-            headers["Content-Type"] = content_type;
-        }
-    };
+                std::lock_guard<std::mutex> lock(shards_mtx_);
+                shards_.push_back(std::make_unique<Shard>(route_count()));
+                cache.push_back({ instance_id_, shards_.back().get() });
+                return shards_.back().get();
+            }
+
+            std::atomic<size_t> route_count_{ 1 };
+            mutable std::mutex shards_mtx_;
+            std::vector<std::unique_ptr<Shard>> shards_;
+            uint64_t instance_id_ = next_instance_id_.fetch_add(1);
+            static inline std::atomic<uint64_t> next_instance_id_{ 1 };
+        };
+
+    } // namespace detail
 
     class Server {
     public:
-        using Handler = std::function<void(const Request&, Response&)>;
+        using Handler = httplib::Handler;
 
         Server() {
 #ifdef _WIN32
@@ -71,40 +1978,211 @@ namespace httplib {
         }
 
         Server& Get(const std::string& pattern, Handler handler) {
-            get_handlers_.push_back({ pattern, handler });
+            router_.add(detail::Method::Get, pattern, std::move(handler), add_route_label(detail::Method::Get, pattern));
             return *this;
         }
 
         Server& Post(const std::string& pattern, Handler handler) {
-            post_handlers_.push_back({ pattern, handler });
+            router_.add(detail::Method::Post, pattern, std::move(handler), add_route_label(detail::Method::Post, pattern));
             return *this;
         }
 
         Server& Put(const std::string& pattern, Handler handler) {
-            put_handlers_.push_back({ pattern, handler });
+            router_.add(detail::Method::Put, pattern, std::move(handler), add_route_label(detail::Method::Put, pattern));
             return *this;
         }
 
         Server& Patch(const std::string& pattern, Handler handler) {
-            patch_handlers_.push_back({ pattern, handler });
+            router_.add(detail::Method::Patch, pattern, std::move(handler), add_route_label(detail::Method::Patch, pattern));
             return *this;
         }
 
         Server& Delete(const std::string& pattern, Handler handler) {
-            delete_handlers_.push_back({ pattern, handler });
+            router_.add(detail::Method::Delete, pattern, std::move(handler), add_route_label(detail::Method::Delete, pattern));
             return *this;
         }
 
-        bool listen(const std::string& host, int port) {
-            //  
-            socket_t server_fd = socket(AF_INET, SOCK_STREAM, 0);
-            if (server_fd == invalid_socket) {
-                std::cerr << "Socket creation failed" << std::endl;
-                return false;
+        // Показатель приложения для /metrics (размер очереди, число задач и т.п.),
+        // sample вызывается при каждом чтении метрик из потока запроса
+        Server& set_metrics_gauge(const std::string& name, const std::string& help, std::function<double()> sample) {
+            gauges_.push_back({ name, help, std::move(sample) });
+            return *this;
+        }
+
+        // Дописывает метрики сервера в текстовом формате Prometheus: запросы по
+        // маршрутам и кодам, гистограммы задержек, открытые соединения и показатели приложения
+        void write_metrics(std::pmr::string& out) const {
+            detail::ServerMetrics::Totals totals = metrics_.collect();
+            size_t routes = totals.sum_ns.size();
+            char number[32];
+            auto append_number = [&out, &number](auto value) {
+                auto result = std::to_chars(number, number + sizeof(number), value);
+                out.append(number, result.ptr - number);
+            };
+            auto append_labels = [this, &out](size_t route) {
+                if (route == 0) {
+                    out += "method=\"\",route=\"(unmatched)\"";
+                    return;
+                }
+                out += "method=\"";
+                out += detail::method_name(route_labels_[route - 1].first);
+                out += "\",route=\"";
+                out += route_labels_[route - 1].second;
+                out += "\"";
+            };
+
+            out += "# HELP http_requests_total Requests handled, by route and status code.\n";
+            out += "# TYPE http_requests_total counter\n";
+            for (size_t route = 0; route < routes; route++) {
+                for (size_t slot = 0; slot < detail::ServerMetrics::status_slots; slot++) {
+                    uint64_t count = totals.requests[route * detail::ServerMetrics::status_slots + slot];
+                    if (count == 0) continue;
+                    out += "http_requests_total{";
+                    append_labels(route);
+                    int status = detail::ServerMetrics::slot_status(slot);
+                    out += ",status=\"";
+                    if (status != 0) append_number(status);
+                    else out += "other";
+                    out += "\"} ";
+                    append_number(count);
+                    out += "\n";
+                }
+            }
+
+            out += "# HELP http_request_duration_seconds Time from parsed request to queued response.\n";
+            out += "# TYPE http_request_duration_seconds histogram\n";
+            for (size_t route = 0; route < routes; route++) {
+                const uint64_t* buckets = &totals.buckets[route * detail::ServerMetrics::bucket_count];
+                uint64_t total = 0;
+                for (size_t i = 0; i < detail::ServerMetrics::bucket_count; i++) total += buckets[i];
+                if (total == 0) continue;
+
+                uint64_t cumulative = 0;
+                for (size_t i = 0; i + 1 < detail::ServerMetrics::bucket_count; i++) {
+                    cumulative += buckets[i];
+                    out += "http_request_duration_seconds_bucket{";
+                    append_labels(route);
+                    out += ",le=\"";
+                    int n = std::snprintf(number, sizeof(number), "%g", detail::ServerMetrics::bucket_upper_us(i) / 1e6);
+                    out.append(number, n);
+                    out += "\"} ";
+                    append_number(cumulative);
+                    out += "\n";
+                }
+                out += "http_request_duration_seconds_bucket{";
+                append_labels(route);
+                out += ",le=\"+Inf\"} ";
+                append_number(total);
+                out += "\nhttp_request_duration_seconds_sum{";
+                append_labels(route);
+                out += "} ";
+                int n = std::snprintf(number, sizeof(number), "%.9g", totals.sum_ns[route] / 1e9);
+                out.append(number, n);
+                out += "\nhttp_request_duration_seconds_count{";
+                append_labels(route);
+                out += "} ";
+                append_number(total);
+                out += "\n";
+            }
+
+            out += "# HELP http_connections_active Open client connections.\n";
+            out += "# TYPE http_connections_active gauge\n";
+            out += "http_connections_active ";
+            append_number(metrics_.active_connections.load(std::memory_order_relaxed));
+            out += "\n";
+
+            for (const Gauge& gauge : gauges_) {
+                out += "# HELP " + gauge.name + " " + gauge.help + "\n";
+                out += "# TYPE " + gauge.name + " gauge\n";
+                out += gauge.name;
+                out += " ";
+                int n = std::snprintf(number, sizeof(number), "%.17g", gauge.sample());
+                out.append(number, n);
+                out += "\n";
             }
+        }
+
+        // Количество рабочих потоков (0 - по числу ядер)
+        Server& set_thread_pool_count(size_t count) {
+            thread_pool_count_ = count;
+            return *this;
+        }
+
+        // Сверх этого лимита новые соединения получают 503
+        Server& set_max_queued_connections(size_t count) {
+            max_queued_connections_ = count;
+            return *this;
+        }
+
+        // Не больше rate запросов в секунду с одного IP-адреса, кратковременно -
+        // до burst подряд (rate 0 - без ограничения). Сверх лимита - 429 с Retry-After
+        Server& set_rate_limit(double rate, double burst) {
+            rate_limiter_.configure(rate, burst);
+            return *this;
+        }
+
+        // Сверх этого числа открытых соединений новые сразу получают 503 (0 - без ограничения)
+        Server& set_max_connections(size_t count) {
+            max_connections_ = count;
+            return *this;
+        }
+
+        // Запрос, прождавший обработки дольше timeout (в очереди пула или за
+        // конвейерными запросами того же соединения), получает 503, не доходя
+        // до обработчика (0 - без ограничения)
+        Server& set_request_timeout(std::chrono::milliseconds timeout) {
+            request_timeout_ = timeout;
+            return *this;
+        }
+
+        // Тела не короче bytes сжимаются gzip/deflate, если клиент их принимает
+        // (Accept-Encoding); потоковые ответы сжимаются всегда. Без zlib не действует
+        Server& set_compression_threshold(size_t bytes) {
+            compression_threshold_ = bytes;
+            return *this;
+        }
+
+        // Количество потоков epoll (0 - по числу ядер), только Linux
+        Server& set_event_loop_count(size_t count) {
+            event_loop_count_ = count;
+            return *this;
+        }
+
+        // Максимальный размер тела запроса (больше - ответ 413)
+        Server& set_payload_max_length(size_t length) {
+            parser_limits_.payload_max_length = length;
+            return *this;
+        }
+
+        // Максимальный размер строки запроса и заголовков (больше - ответ 431)
+        Server& set_header_max_length(size_t length) {
+            parser_limits_.header_max_length = length;
+            return *this;
+        }
+
+        // Время простоя keep-alive соединения до закрытия
+        Server& set_keep_alive_timeout(int seconds) {
+            keep_alive_timeout_sec_ = seconds;
+            return *this;
+        }
+
+        // Каждый цикл epoll открывает свой слушающий сокет с SO_REUSEPORT и сам
+        // принимает соединения; ядро распределяет их между сокетами, общей
+        // очереди accept и передачи соединений между потоками нет. Только Linux
+        Server& set_reuse_port(bool enable) {
+            reuse_port_ = enable;
+            return *this;
+        }
+
+        // Закреплять поток i-го цикла epoll за ядром i (по кругу), только Linux
+        Server& set_cpu_affinity(bool enable) {
+            cpu_affinity_ = enable;
+            return *this;
+        }
 
-            //  
-            sockaddr_in address;
+        bool listen(const std::string& host, int port) {
+            // Настройка адреса
+            sockaddr_in address{};
             address.sin_family = AF_INET;
             address.sin_port = htons(port);
 
@@ -115,41 +2193,22 @@ namespace httplib {
                 inet_pton(AF_INET, host.c_str(), &address.sin_addr);
             }
 
-            //  
-            int opt = 1;
-#ifdef _WIN32
-            setsockopt(server_fd, SOL_SOCKET, SO_REUSEADDR, (char*)&opt, sizeof(opt));
-#else
-            setsockopt(server_fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
-#endif
-
-            if (bind(server_fd, (sockaddr*)&address, sizeof(address)) < 0) {
-                std::cerr << "Bind failed" << std::endl;
-#ifdef _WIN32
-                closesocket(server_fd);
-#else
-                close(server_fd);
-#endif
-                return false;
-            }
-
-            //  
-            if (::listen(server_fd, 3) < 0) {
-                std::cerr << "Listen failed" << std::endl;
-#ifdef _WIN32
-                closesocket(server_fd);
-#else
-                close(server_fd);
-#endif
-                return false;
-            }
+            socket_t server_fd = create_listener(address);
+            if (server_fd == invalid_socket) return false;
 
             std::cout << "Server listening on http://" << host << ":" << port << std::endl;
             std::cout << "Press Ctrl+C to stop" << std::endl;
 
             running_ = true;
 
-            //   
+#ifdef CPPHTTPLIB_USE_EPOLL
+            bool result = run_event_loops(server_fd, address);
+            close(server_fd);
+            return result;
+#else
+            ThreadPool pool(thread_pool_count_, max_queued_connections_);
+
+            // Основной цикл сервера
             while (running_) {
                 sockaddr_in client_addr;
 #ifdef _WIN32
@@ -167,12 +2226,24 @@ namespace httplib {
                     continue;
                 }
 
-                //     
-                std::thread([this, client_fd]() {
-                    handle_client(client_fd);
-                    }).detach();
+                if (over_connection_limit()) {
+                    reject_client(client_fd);
+                    continue;
+                }
+
+                // Передаем соединение в пул потоков; время ожидания в очереди
+                // пула входит в ожидание запроса
+                uint32_t remote_addr = client_addr.sin_addr.s_addr;
+                auto accepted_at = std::chrono::steady_clock::now();
+                if (!pool.enqueue([this, client_fd, remote_addr, accepted_at]() {
+                    handle_client(client_fd, remote_addr, accepted_at);
+                    })) {
+                    reject_client(client_fd);
+                }
             }
 
+            pool.shutdown();
+
 #ifdef _WIN32
             closesocket(server_fd);
 #else
@@ -180,126 +2251,541 @@ namespace httplib {
 #endif
 
             return true;
+#endif
         }
 
         void stop() {
             running_ = false;
-            //   accept()   ,      
+            // Для прерывания accept() нужно закрыть сокет, но в упрощенной версии просто выходим
         }
 
     private:
-        void handle_client(socket_t client_fd) {
-            char buffer[4096] = { 0 };
+        struct Gauge {
+            std::string name;
+            std::string help;
+            std::function<double()> sample;
+        };
 
-#ifdef _WIN32
-            int bytes_received = recv(client_fd, buffer, sizeof(buffer) - 1, 0);
-#else
-            ssize_t bytes_received = recv(client_fd, buffer, sizeof(buffer) - 1, 0);
-#endif
+        // Номер нового маршрута для метрик
+        size_t add_route_label(detail::Method method, const std::string& pattern) {
+            route_labels_.emplace_back(method, pattern);
+            metrics_.set_route_count(route_labels_.size() + 1);
+            return route_labels_.size();
+        }
+
+        // Сокет, привязанный к адресу и слушающий; invalid_socket при ошибке
+        socket_t create_listener(const sockaddr_in& address) {
+            socket_t server_fd = socket(AF_INET, SOCK_STREAM, 0);
+            if (server_fd == invalid_socket) {
+                std::cerr << "Socket creation failed" << std::endl;
+                return invalid_socket;
+            }
 
-            if (bytes_received <= 0) {
+            int opt = 1;
 #ifdef _WIN32
-                closesocket(client_fd);
+            setsockopt(server_fd, SOL_SOCKET, SO_REUSEADDR, (char*)&opt, sizeof(opt));
 #else
-                close(client_fd);
+            setsockopt(server_fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
 #endif
-                return;
+#if defined(CPPHTTPLIB_USE_EPOLL) && defined(SO_REUSEPORT)
+            if (reuse_port_) setsockopt(server_fd, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt));
+#endif
+
+            if (bind(server_fd, (const sockaddr*)&address, sizeof(address)) < 0) {
+                std::cerr << "Bind failed" << std::endl;
+                detail::close_socket(server_fd);
+                return invalid_socket;
+            }
+
+            // Слушаем порт
+            if (::listen(server_fd, CPPHTTPLIB_LISTEN_BACKLOG) < 0) {
+                std::cerr << "Listen failed" << std::endl;
+                detail::close_socket(server_fd);
+                return invalid_socket;
+            }
+            return server_fd;
+        }
+
+        bool over_connection_limit() const {
+            return max_connections_ > 0 &&
+                metrics_.active_connections.load(std::memory_order_relaxed) >= (int64_t)max_connections_;
+        }
+
+        // Очередь пула заполнена или открыто слишком много соединений -
+        // сразу отвечаем 503, не читая запрос
+        void reject_client(socket_t client_fd) {
+            metrics_.record_status(0, 503);
+            static const char response[] =
+                "HTTP/1.1 503 Service Unavailable\r\n"
+                "Content-Type: application/json\r\n"
+                "Content-Length: 31\r\n"
+                "Retry-After: 1\r\n"
+                "Connection: close\r\n\r\n"
+                "{\"error\":\"Service Unavailable\"}";
+            send(client_fd, response, sizeof(response) - 1, 0);
+            detail::close_socket(client_fd);
+        }
+
+#ifdef CPPHTTPLIB_USE_EPOLL
+        // Принимаем соединения и раздаем их циклам epoll по кругу. С SO_REUSEPORT
+        // у каждого цикла свой слушающий сокет (первый - server_fd), и этот поток
+        // только ждет остановки
+        bool run_event_loops(socket_t server_fd, const sockaddr_in& address) {
+            size_t count = event_loop_count_;
+            unsigned cores = std::max(1u, std::thread::hardware_concurrency());
+            if (count == 0) count = cores;
+
+            std::vector<std::unique_ptr<detail::EpollLoop>> loops;
+            std::vector<socket_t> listeners;
+            auto shutdown = [&]() {
+                for (auto& loop : loops) loop->stop();
+                for (socket_t fd : listeners) close(fd);
+            };
+            for (size_t i = 0; i < count; i++) {
+                loops.push_back(std::make_unique<detail::EpollLoop>(
+                    [this](detail::Session& session) { return process_session(session); },
+                    keep_alive_timeout_sec_, parser_limits_, metrics_.active_connections));
+                if (reuse_port_) {
+                    socket_t fd = i == 0 ? server_fd : create_listener(address);
+                    if (fd == invalid_socket) {
+                        shutdown();
+                        return false;
+                    }
+                    if (i > 0) listeners.push_back(fd);
+                    loops.back()->set_listener(fd, [this](socket_t client_fd) {
+                        if (!over_connection_limit()) return true;
+                        reject_client(client_fd);
+                        return false;
+                        });
+                }
+                if (!loops.back()->start(cpu_affinity_ ? (int)(i % cores) : -1)) {
+                    std::cerr << "Event loop creation failed" << std::endl;
+                    shutdown();
+                    return false;
+                }
+            }
+
+            if (reuse_port_) {
+                // stop() только сбрасывает флаг - проверяем его периодически
+                while (running_) std::this_thread::sleep_for(std::chrono::milliseconds(100));
+                shutdown();
+                return true;
+            }
+
+            size_t next = 0;
+            while (running_) {
+                sockaddr_in client_addr;
+                socklen_t addrlen = sizeof(client_addr);
+                socket_t client_fd = accept4(server_fd, (sockaddr*)&client_addr, &addrlen, SOCK_CLOEXEC);
+
+                if (client_fd == invalid_socket) {
+                    if (running_ && errno != EINTR) {
+                        std::cerr << "Accept failed" << std::endl;
+                    }
+                    continue;
+                }
+
+                if (over_connection_limit()) {
+                    reject_client(client_fd);
+                    continue;
+                }
+                loops[next++ % loops.size()]->add(client_fd, client_addr.sin_addr.s_addr);
             }
 
-            buffer[bytes_received] = '\0';
-            std::string request_str(buffer);
+            shutdown();
+            return true;
+        }
+#endif
+
+    public:
+        // Обработка без сокетов - для встраивания сервера в процесс и замеров.
+        // Передает разобранный запрос маршрутизатору (с проверками admit) и
+        // учитывает его в метриках. Потоковый ответ остается в res.content_provider,
+        // тело не сжимается. Поля req.path и req.target должны быть заполнены
+        size_t dispatch(Request& req, Response& res) {
+            auto started = std::chrono::steady_clock::now();
+            size_t route_id = route(req, res);
+            metrics_.record(route_id, res.status, std::chrono::steady_clock::now() - started);
+            return route_id;
+        }
+
+        // Разбирает все полные запросы из буфера соединения (keep-alive и конвейер).
+        // Потоковый ответ останавливает разбор до своего завершения.
+        // Это весь путь запроса между чтением из сокета и отправкой: байты
+        // кладутся в session.in, ответы забираются из session.out и session.stream
+        bool process_session(detail::Session& session) {
+            std::string& in = session.in;
+            detail::OutputQueue& out = session.out;
+            detail::RequestParser& parser = session.parser;
+            bool keep_alive = true;
 
-            //  HTTP 
-            Request req;
-            Response res;
+            // Вызывается только с пустой очередью отправки: предыдущие ответы
+            // ушли целиком, и их память можно переиспользовать
+            session.arena.release();
+
+            while (keep_alive && !session.stream) {
+                auto result = parser.parse(in);
+                if (result == detail::RequestParser::Result::Incomplete) {
+                    if (parser.expects_continue()) {
+                        out.append(std::string_view("HTTP/1.1 100 Continue\r\n\r\n"));
+                        parser.clear_expect_continue();
+                    }
+                    break;
+                }
+                if (result == detail::RequestParser::Result::Error) {
+                    write_error(parser.error_status(), out, session.arena.resource());
+                    metrics_.record_status(0, parser.error_status());
+                    keep_alive = false;
+                    break;
+                }
 
-            //    
-            size_t method_end = request_str.find(' ');
-            if (method_end != std::string::npos) {
-                req.method = request_str.substr(0, method_end);
+                Request req(session.arena.resource());
+                Response res(session.arena.resource());
+                parser.fill(in, req);
+                req.remote_addr = session.remote_addr;
+                req.received_at = session.received_at;
 
-                size_t path_start = method_end + 1;
-                size_t path_end = request_str.find(' ', path_start);
-                if (path_end != std::string::npos) {
-                    req.path = request_str.substr(path_start, path_end - path_start);
+                keep_alive = wants_keep_alive(req);
+                auto started = std::chrono::steady_clock::now();
+                size_t route_id = route(req, res);
+                bool chunked = res.content_provider && req.version == "HTTP/1.1";
+                if (res.content_provider && !chunked) read_content(res);
+                detail::Encoding encoding = prepare_compression(req, res);
+                if (chunked) {
+                    write_headers(res, keep_alive, true, out);
+                    session.stream = detail::make_chunked_stream(std::move(res.content_provider), session.waker, encoding);
                 }
+                else {
+                    write_response(res, keep_alive, out);
+                }
+                // Для потокового ответа - время до заголовков
+                metrics_.record(route_id, res.status, std::chrono::steady_clock::now() - started);
+                parser.reset(parser.begin() + parser.consumed());
             }
 
-            //   
-            size_t body_start = request_str.find("\r\n\r\n");
-            if (body_start != std::string::npos) {
-                req.body = request_str.substr(body_start + 4);
+            // Удаляем из буфера уже обработанные запросы
+            size_t done = parser.begin();
+            if (done > 0) {
+                in.erase(0, done);
+                parser.rebase(done);
             }
+            return keep_alive;
+        }
+
+    private:
+        void handle_client(socket_t client_fd, uint32_t remote_addr, std::chrono::steady_clock::time_point accepted_at) {
+            metrics_.active_connections.fetch_add(1, std::memory_order_relaxed);
+            handle_connection(client_fd, remote_addr, accepted_at);
+            metrics_.active_connections.fetch_sub(1, std::memory_order_relaxed);
+        }
+
+        void handle_connection(socket_t client_fd, uint32_t remote_addr, std::chrono::steady_clock::time_point accepted_at) {
+            std::string buffer;
+            detail::OutputQueue response_str;
+            detail::RequestParser parser(parser_limits_);
+            // Живет до закрытия соединения: тело ответа отправляется прямо из нее
+            detail::RequestArena arena;
+
+            for (;;) {
+                auto result = parser.parse(buffer);
+                if (result == detail::RequestParser::Result::Complete) break;
+                if (result == detail::RequestParser::Result::Error) {
+                    write_error(parser.error_status(), response_str, arena.resource());
+                    metrics_.record_status(0, parser.error_status());
+                    send_all(client_fd, response_str);
+                    detail::close_socket(client_fd);
+                    return;
+                }
+                if (parser.expects_continue()) {
+                    send_all(client_fd, "HTTP/1.1 100 Continue\r\n\r\n");
+                    parser.clear_expect_continue();
+                }
 
-            //     
-            size_t query_pos = req.path.find('?');
-            if (query_pos != std::string::npos) {
-                req.path = req.path.substr(0, query_pos);
+                char chunk[4096];
+                auto bytes_received = recv(client_fd, chunk, sizeof(chunk), 0);
+                if (bytes_received <= 0) {
+                    detail::close_socket(client_fd);
+                    return;
+                }
+                buffer.append(chunk, bytes_received);
             }
 
-            //   
-            bool handled = false;
+            Request req(arena.resource());
+            Response res(arena.resource());
+            parser.fill(buffer, req);
+            req.remote_addr = remote_addr;
+            req.received_at = accepted_at;
+            auto started = std::chrono::steady_clock::now();
+            size_t route_id = route(req, res);
+            bool chunked = res.content_provider && req.version == "HTTP/1.1";
+            if (res.content_provider && !chunked) read_content(res);
+            detail::Encoding encoding = prepare_compression(req, res);
 
-            if (req.method == "GET") {
-                handled = try_handle(get_handlers_, req, res);
+            if (chunked) {
+                write_headers(res, false, true, response_str);
+                metrics_.record(route_id, res.status, std::chrono::steady_clock::now() - started);
+                // Провайдер без данных ждет пробуждения на этом же потоке
+                struct WakeState {
+                    std::mutex mtx;
+                    std::condition_variable cv;
+                    bool woken = false;
+                };
+                auto wake_state = std::make_shared<WakeState>();
+                auto stream = detail::make_chunked_stream(std::move(res.content_provider), [wake_state]() {
+                    std::lock_guard<std::mutex> lock(wake_state->mtx);
+                    wake_state->woken = true;
+                    wake_state->cv.notify_one();
+                    }, encoding);
+                for (;;) {
+                    auto result = stream(response_str);
+                    if (result == detail::StreamResult::Error) break;
+                    if (result == detail::StreamResult::Continue && response_str.empty()) {
+                        std::unique_lock<std::mutex> lock(wake_state->mtx);
+                        wake_state->cv.wait_for(lock, std::chrono::seconds(1), [&]() { return wake_state->woken; });
+                        wake_state->woken = false;
+                        continue;
+                    }
+                    if (!send_all(client_fd, response_str)) break;
+                    if (result == detail::StreamResult::Done) break;
+                }
             }
-            else if (req.method == "POST") {
-                handled = try_handle(post_handlers_, req, res);
+            else {
+                write_response(res, false, response_str);
+                metrics_.record(route_id, res.status, std::chrono::steady_clock::now() - started);
+                send_all(client_fd, response_str);
+            }
+            detail::close_socket(client_fd);
+        }
+
+        // Блокирующая отправка с учетом частичной записи
+        static bool send_all(socket_t sock, std::string_view data) {
+            while (!data.empty()) {
+                auto n = send(sock, data.data(), (int)data.size(), 0);
+                if (n <= 0) return false;
+                data.remove_prefix(n);
             }
-            else if (req.method == "PUT") {
-                handled = try_handle(put_handlers_, req, res);
+            return true;
+        }
+
+        // Блокирующая отправка очереди сегментов (writev с учетом частичной записи)
+        static bool send_all(socket_t sock, detail::OutputQueue& out) {
+            while (!out.empty()) {
+                long n = detail::send_some(sock, out);
+                if (n > 0) continue;
+#ifndef _WIN32
+                if (n < 0 && errno == EINTR) continue;
+#endif
+                return false;
             }
-            else if (req.method == "PATCH") {
-                handled = try_handle(patch_handlers_, req, res);
+            return true;
+        }
+
+        // resource должен жить, пока out не будет отправлена
+        void write_error(int status, detail::OutputQueue& out, std::pmr::memory_resource* resource) {
+            Response res(resource);
+            res.status = status;
+            std::pmr::string& body = res.begin_content("application/json");
+            body += "{\"error\":\"";
+            body += detail::status_message(status);
+            body += "\"}";
+            write_response(res, false, out);
+        }
+
+        bool wants_keep_alive(const Request& req) const {
+            for (const auto& [name, value] : req.headers) {
+                if (detail::iequals(name, "Connection")) {
+                    if (detail::iequals(value, "close")) return false;
+                    if (detail::iequals(value, "keep-alive")) return true;
+                }
             }
-            else if (req.method == "DELETE") {
-                handled = try_handle(delete_handlers_, req, res);
+            return req.version == "HTTP/1.1";
+        }
+
+        // Вызываем соответствующий обработчик; возвращает номер маршрута для метрик
+        size_t route(Request& req, Response& res) {
+            detail::parse_query(req);
+
+            detail::Method method;
+            const Handler* handler = nullptr;
+            size_t route_id = 0;
+            if (detail::method_from_string(req.method, method)) {
+                handler = router_.match(method, req, route_id);
             }
 
-            if (!handled) {
+            if (!handler) {
                 res.status = 404;
                 res.set_content("{\"error\":\"Not found\"}", "application/json");
             }
+            else if (admit(req, res)) {
+                (*handler)(req, res);
+            }
+            return route_id;
+        }
+
+        // Отсеивает запрос до обработчика: слишком долго ждал (503) или
+        // клиент превысил частоту запросов (429). Ответ пишется в res
+        bool admit(const Request& req, Response& res) {
+            bool check_deadline = request_timeout_.count() > 0 &&
+                req.received_at != std::chrono::steady_clock::time_point();
+            bool check_rate = rate_limiter_.enabled() && req.remote_addr != 0;
+            if (!check_deadline && !check_rate) return true;
+
+            auto now = std::chrono::steady_clock::now();
+            if (check_deadline && now - req.received_at > request_timeout_) {
+                res.status = 503;
+                res.set_header("Retry-After", "1");
+                res.set_content("{\"error\":\"Request timed out in queue\"}", "application/json");
+                return false;
+            }
+
+            double retry_after = 0;
+            if (check_rate && !rate_limiter_.acquire(req.remote_addr, now, retry_after)) {
+                // Retry-After - целые секунды, округляем вверх
+                int wait = (int)retry_after;
+                if (wait < retry_after) wait++;
+                char seconds[16];
+                auto result = std::to_chars(seconds, seconds + sizeof(seconds), wait);
+                res.status = 429;
+                res.set_header("Retry-After", std::string_view(seconds, result.ptr - seconds));
+                res.set_content("{\"error\":\"Too Many Requests\"}", "application/json");
+                return false;
+            }
+            return true;
+        }
+
+        // Клиенту без chunked (HTTP/1.0) потоковый ответ отдаем целиком
+        void read_content(Response& res) {
+            bool finished = false;
+            DataSink sink;
+            sink.write = [&res](const char* data, size_t length) {
+                res.body.append(data, length);
+                return true;
+            };
+            sink.done = [&finished]() { finished = true; };
+            while (!finished) {
+                size_t before = res.body.size();
+                if (!res.content_provider(before, sink) || (!finished && res.body.size() == before)) {
+                    res.headers.clear();
+                    res.status = 500;
+                    res.set_content("{\"error\":\"Internal Server Error\"}", "application/json");
+                    break;
+                }
+            }
+            res.content_provider = nullptr;
+        }
+
+        // Сжимает тело ответа, если клиент принимает gzip/deflate, тип тела
+        // сжимаемый и тело не короче порога. Общие тела сжимаются один раз
+        // (CompressionCache). Для потокового ответа только выставляет заголовки
+        // и возвращает кодировку, сжимает сам поток
+        detail::Encoding prepare_compression(const Request& req, Response& res) {
+#ifdef CPPHTTPLIB_ZLIB_SUPPORT
+            if (res.status < 200 || res.status == 204 || res.status == 304) return detail::Encoding::Identity;
+            std::string_view content_type;
+            for (const auto& [name, value] : res.headers) {
+                if (name == "Content-Encoding") return detail::Encoding::Identity;
+                if (name == "Content-Type") content_type = value;
+            }
+            if (!detail::compressible(content_type)) return detail::Encoding::Identity;
+            if (!res.content_provider && res.body_size() < compression_threshold_) return detail::Encoding::Identity;
 
-            //  HTTP 
-            std::string response_str = "HTTP/1.1 " + std::to_string(res.status) + " OK\r\n";
-            response_str += "Content-Type: " + res.headers["Content-Type"] + "\r\n";
-            response_str += "Content-Length: " + std::to_string(res.body.size()) + "\r\n";
-            response_str += "Connection: close\r\n\r\n";
-            response_str += res.body;
+            // Ответ зависит от Accept-Encoding - это нужно знать кэшам по пути
+            res.set_header("Vary", "Accept-Encoding");
+            detail::Encoding encoding = detail::negotiate_encoding(req.get_header_value("Accept-Encoding"));
+            if (encoding == detail::Encoding::Identity) return encoding;
 
-            //  
-#ifdef _WIN32
-            send(client_fd, response_str.c_str(), response_str.size(), 0);
-            closesocket(client_fd);
+            if (!res.content_provider) {
+                if (res.shared_owner) {
+                    auto compressed = compression_cache_.find(res.shared_owner, res.shared_view, encoding);
+                    if (!compressed) {
+                        auto fresh = std::make_shared<std::string>();
+                        detail::Compressor compressor(encoding);
+                        if (!compressor.compress(res.shared_view, Z_FINISH, *fresh)) return detail::Encoding::Identity;
+                        compressed = std::move(fresh);
+                        compression_cache_.insert(res.shared_owner, res.shared_view, encoding, compressed);
+                    }
+                    // Несжимаемые данные отдаем как есть
+                    if (compressed->size() >= res.shared_view.size()) return detail::Encoding::Identity;
+                    res.shared_view = *compressed;
+                    res.shared_owner = std::move(compressed);
+                }
+                else {
+                    std::pmr::string compressed(res.body.get_allocator());
+                    detail::Compressor compressor(encoding);
+                    if (!compressor.compress(res.body, Z_FINISH, compressed) || compressed.size() >= res.body.size()) {
+                        return detail::Encoding::Identity;
+                    }
+                    res.body.swap(compressed);
+                }
+            }
+
+            res.set_header("Content-Encoding", detail::encoding_name(encoding));
+            // Сильный ETag обещает побайтно одинаковое тело, а сжатое отличается:
+            // метка становится слабой (If-None-Match сравнивает их без W/)
+            for (auto& [name, value] : res.headers) {
+                if (name == "ETag" && value.substr(0, 2) != "W/") value.insert(0, "W/");
+            }
+            return encoding;
 #else
-            send(client_fd, response_str.c_str(), response_str.size(), 0);
-            close(client_fd);
+            (void)req;
+            (void)res;
+            return detail::Encoding::Identity;
 #endif
         }
 
-        bool try_handle(const std::vector<std::pair<std::string, Handler>>& handlers,
-            const Request& req, Response& res) {
-            for (const auto& [pattern, handler] : handlers) {
-                std::regex re(pattern);
-                std::smatch matches;
+        // Формируем HTTP ответ
+        void write_response(Response& res, bool keep_alive, detail::OutputQueue& out) {
+            if (res.content_provider) read_content(res);
 
-                if (std::regex_match(req.path, matches, re)) {
-                    //  matches  req    handler
-                    Request req_copy = req;
-                    req_copy.matches = matches;
-                    handler(req_copy, res);
-                    return true;
-                }
+            write_headers(res, keep_alive, false, out);
+            // Тело из арены запроса: арена освобождается только после отправки
+            if (res.shared_owner) out.append(res.shared_owner, res.shared_view);
+            else if (!res.body.empty()) out.append_borrowed(res.body);
+        }
+
+        // Заголовки пишутся прямо в буфер соединения, без промежуточных строк
+        void write_headers(const Response& res, bool keep_alive, bool chunked, detail::OutputQueue& queue) {
+            std::string& out = queue.tail();
+            out += detail::status_line(res.status);
+            for (const auto& [name, value] : res.headers) {
+                out += name;
+                out += ": ";
+                out += value;
+                out += "\r\n";
             }
-            return false;
+            if (chunked) {
+                out += "Transfer-Encoding: chunked\r\n";
+            }
+            else if (res.status != 204 && res.status != 304) {
+                char length[24];
+                auto result = std::to_chars(length, length + sizeof(length), res.body_size());
+                out += "Content-Length: ";
+                out.append(length, result.ptr - length);
+                out += "\r\n";
+            }
+            out += keep_alive ? "Connection: keep-alive\r\n\r\n" : "Connection: close\r\n\r\n";
         }
-        std::vector<std::pair<std::string, Handler>> get_handlers_;
-        std::vector<std::pair<std::string, Handler>> post_handlers_;
-        std::vector<std::pair<std::string, Handler>> put_handlers_;
-        std::vector<std::pair<std::string, Handler>> patch_handlers_;
-        std::vector<std::pair<std::string, Handler>> delete_handlers_;
+
+        detail::Router router_;
+        // route_labels_[i - 1] - метод и шаблон маршрута с номером i
+        std::vector<std::pair<detail::Method, std::string>> route_labels_;
+        std::vector<Gauge> gauges_;
+        detail::ServerMetrics metrics_;
+        detail::RateLimiter rate_limiter_;
+#ifdef CPPHTTPLIB_ZLIB_SUPPORT
+        detail::CompressionCache compression_cache_;
+#endif
         std::atomic<bool> running_{ false };
+        size_t thread_pool_count_ = CPPHTTPLIB_THREAD_POOL_COUNT;
+        size_t max_queued_connections_ = CPPHTTPLIB_MAX_QUEUED_CONNECTIONS;
+        size_t event_loop_count_ = CPPHTTPLIB_EVENT_LOOP_COUNT;
+        int keep_alive_timeout_sec_ = CPPHTTPLIB_KEEPALIVE_TIMEOUT_SECOND;
+        size_t max_connections_ = CPPHTTPLIB_MAX_CONNECTIONS;
+        std::chrono::milliseconds request_timeout_{ CPPHTTPLIB_REQUEST_TIMEOUT_MSEC };
+        size_t compression_threshold_ = CPPHTTPLIB_COMPRESSION_THRESHOLD;
+        bool reuse_port_ = false;
+        bool cpu_affinity_ = false;
+        detail::ParserLimits parser_limits_;
     };
 
 } // namespace httplib
\ No newline at end of file
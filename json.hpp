@@ -1,4 +1,4 @@
-// json.hpp -  
+// json.hpp - минимальная версия
 #pragma once
 
 #include <map>
@@ -20,14 +20,14 @@ namespace nlohmann {
         json(const std::map<std::string, json>& v) : type(value_t::object), object_value(v) {}
         json(const std::vector<json>& v) : type(value_t::array), array_value(v) {}
 
-        //     
+        // Простые методы для нашего использования
         template<typename T>
         T value(const std::string& key, T default_value) const {
             if (type != value_t::object) return default_value;
             auto it = object_value.find(key);
             if (it == object_value.end()) return default_value;
 
-            //  
+            // Простейшая конвертация
             if constexpr (std::is_same_v<T, std::string>) {
                 return it->second.type == value_t::string ? it->second.string_value : std::to_string(it->second.int_value);
             }
@@ -87,13 +87,13 @@ namespace nlohmann {
         }
 
         static json parse(const std::string& s) {
-            //    
+            // Простейший парсер для тестирования
             json result;
 
             if (s.empty()) return result;
 
             if (s[0] == '{') {
-                //    {"key": "value"}
+                // Простой объект типа {"key": "value"}
                 result.type = value_t::object;
                 std::string content = s.substr(1, s.size() - 2);
                 size_t colon_pos = content.find(':');
@@ -101,7 +101,7 @@ namespace nlohmann {
                     std::string key = content.substr(1, content.find('"', 1) - 1);
                     std::string value = content.substr(colon_pos + 1);
 
-                    //    
+                    // Убираем кавычки если есть
                     if (value.front() == '"' && value.back() == '"') {
                         value = value.substr(1, value.size() - 2);
                     }
@@ -134,7 +134,7 @@ namespace nlohmann {
             return result;
         }
 
-        //  []  
+        // Оператор [] для удобства
         json& operator[](const std::string& key) {
             if (type != value_t::object) {
                 type = value_t::object;
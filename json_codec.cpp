@@ -0,0 +1,378 @@
+#include "json_codec.h"
+#include <charconv>
+
+namespace {
+
+    // Длина корректной UTF-8 последовательности в начале p или 0, если она некорректна
+    // (лишние байты продолжения, "длинные" формы, суррогаты, значения больше U+10FFFF)
+    size_t utf8_sequence_length(const unsigned char* p, size_t available) {
+        unsigned char c = p[0];
+        size_t length;
+        unsigned int min_code;
+        unsigned int code;
+
+        if (c < 0x80) return 1;
+        if ((c & 0xE0) == 0xC0) { length = 2; min_code = 0x80; code = c & 0x1F; }
+        else if ((c & 0xF0) == 0xE0) { length = 3; min_code = 0x800; code = c & 0x0F; }
+        else if ((c & 0xF8) == 0xF0) { length = 4; min_code = 0x10000; code = c & 0x07; }
+        else return 0;
+
+        if (available < length) return 0;
+        for (size_t i = 1; i < length; i++) {
+            if ((p[i] & 0xC0) != 0x80) return 0;
+            code = (code << 6) | (p[i] & 0x3F);
+        }
+        if (code < min_code || code > 0x10FFFF || (code >= 0xD800 && code <= 0xDFFF)) return 0;
+        return length;
+    }
+
+    template <typename String>
+    void append_string(String& out, std::string_view s) {
+        static const char hex[] = "0123456789abcdef";
+        const unsigned char* p = reinterpret_cast<const unsigned char*>(s.data());
+        size_t size = s.size();
+        size_t run = 0;  // начало еще не скопированного куска
+
+        out.reserve(out.size() + size + 2);
+        out += '"';
+        size_t i = 0;
+        while (i < size) {
+            unsigned char c = p[i];
+            if (c >= 0x20 && c != '"' && c != '\\' && c < 0x80) {
+                i++;
+                continue;
+            }
+            if (c >= 0x80) {
+                size_t length = utf8_sequence_length(p + i, size - i);
+                if (length > 0) {
+                    i += length;
+                    continue;
+                }
+            }
+
+            out.append(s.data() + run, i - run);
+            switch (c) {
+            case '"': out += "\\\""; break;
+            case '\\': out += "\\\\"; break;
+            case '\n': out += "\\n"; break;
+            case '\r': out += "\\r"; break;
+            case '\t': out += "\\t"; break;
+            case '\b': out += "\\b"; break;
+            case '\f': out += "\\f"; break;
+            default:
+                if (c < 0x20) {
+                    out += "\\u00";
+                    out += hex[c >> 4];
+                    out += hex[c & 0xF];
+                }
+                else {
+                    out += "\xEF\xBF\xBD";  // U+FFFD вместо некорректного байта
+                }
+            }
+            i++;
+            run = i;
+        }
+        out.append(s.data() + run, size - run);
+        out += '"';
+    }
+
+    template <typename String>
+    void append_int(String& out, long long value) {
+        char buffer[24];
+        auto result = std::to_chars(buffer, buffer + sizeof(buffer), value);
+        out.append(buffer, result.ptr - buffer);
+    }
+
+    void append_utf8(std::string& out, unsigned int code) {
+        if (code < 0x80) {
+            out += (char)code;
+        }
+        else if (code < 0x800) {
+            out += (char)(0xC0 | (code >> 6));
+            out += (char)(0x80 | (code & 0x3F));
+        }
+        else if (code < 0x10000) {
+            out += (char)(0xE0 | (code >> 12));
+            out += (char)(0x80 | ((code >> 6) & 0x3F));
+            out += (char)(0x80 | (code & 0x3F));
+        }
+        else {
+            out += (char)(0xF0 | (code >> 18));
+            out += (char)(0x80 | ((code >> 12) & 0x3F));
+            out += (char)(0x80 | ((code >> 6) & 0x3F));
+            out += (char)(0x80 | (code & 0x3F));
+        }
+    }
+
+    int hex_value(char c) {
+        if (c >= '0' && c <= '9') return c - '0';
+        if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+        if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+        return -1;
+    }
+
+} // namespace
+
+void json_append_string(std::string& out, std::string_view s) {
+    append_string(out, s);
+}
+
+void json_append_string(std::pmr::string& out, std::string_view s) {
+    append_string(out, s);
+}
+
+void json_append_int(std::string& out, long long value) {
+    append_int(out, value);
+}
+
+void json_append_int(std::pmr::string& out, long long value) {
+    append_int(out, value);
+}
+
+bool JsonReader::fail() {
+    failed = true;
+    return false;
+}
+
+void JsonReader::skip_ws() {
+    while (pos < in.size() && (in[pos] == ' ' || in[pos] == '\t' || in[pos] == '\n' || in[pos] == '\r')) pos++;
+}
+
+bool JsonReader::expect(char c) {
+    skip_ws();
+    if (pos >= in.size() || in[pos] != c) return fail();
+    pos++;
+    return true;
+}
+
+bool JsonReader::open(char c) {
+    if (failed) return false;
+    if (depth == max_depth || !expect(c)) return fail();
+    first[depth++] = true;
+    return true;
+}
+
+bool JsonReader::begin_object() {
+    return open('{');
+}
+
+bool JsonReader::begin_array() {
+    return open('[');
+}
+
+// Общая часть next_key/next_element: закрывающая скобка или запятая
+bool JsonReader::next_in_container(char close) {
+    if (failed || depth == 0) return fail();
+    skip_ws();
+    if (pos >= in.size()) return fail();
+
+    if (in[pos] == close) {
+        pos++;
+        depth--;
+        return false;
+    }
+    if (!first[depth - 1]) {
+        if (in[pos] != ',') return fail();
+        pos++;
+    }
+    first[depth - 1] = false;
+    return true;
+}
+
+bool JsonReader::next_key(std::string_view& key) {
+    if (!next_in_container('}')) return false;
+    skip_ws();
+
+    // Ключ без escape-последовательностей отдаем прямо из входа
+    size_t start = pos + 1;
+    size_t end = start;
+    while (end < in.size() && in[end] != '"' && in[end] != '\\' && (unsigned char)in[end] >= 0x20) end++;
+    if (pos < in.size() && in[pos] == '"' && end < in.size() && in[end] == '"') {
+        key = in.substr(start, end - start);
+        pos = end + 1;
+    }
+    else {
+        if (!parse_string(key_buffer)) return false;
+        key = key_buffer;
+    }
+    return expect(':');
+}
+
+bool JsonReader::next_element() {
+    return next_in_container(']');
+}
+
+bool JsonReader::parse_string(std::string& out) {
+    out.clear();
+    if (!expect('"')) return false;
+
+    const unsigned char* p = reinterpret_cast<const unsigned char*>(in.data());
+    size_t run = pos;
+    for (;;) {
+        if (pos >= in.size()) return fail();
+        unsigned char c = p[pos];
+
+        if (c == '"') {
+            out.append(in.data() + run, pos - run);
+            pos++;
+            return true;
+        }
+        if (c < 0x20) return fail();
+        if (c >= 0x80) {
+            size_t length = utf8_sequence_length(p + pos, in.size() - pos);
+            if (length == 0) return fail();
+            pos += length;
+            continue;
+        }
+        if (c != '\\') {
+            pos++;
+            continue;
+        }
+
+        out.append(in.data() + run, pos - run);
+        if (++pos >= in.size()) return fail();
+        switch (in[pos++]) {
+        case '"': out += '"'; break;
+        case '\\': out += '\\'; break;
+        case '/': out += '/'; break;
+        case 'b': out += '\b'; break;
+        case 'f': out += '\f'; break;
+        case 'n': out += '\n'; break;
+        case 'r': out += '\r'; break;
+        case 't': out += '\t'; break;
+        case 'u': {
+            auto read_hex4 = [this](unsigned int& code) {
+                if (in.size() - pos < 4) return false;
+                code = 0;
+                for (int i = 0; i < 4; i++) {
+                    int v = hex_value(in[pos + i]);
+                    if (v < 0) return false;
+                    code = code * 16 + v;
+                }
+                pos += 4;
+                return true;
+            };
+
+            unsigned int code;
+            if (!read_hex4(code)) return fail();
+            if (code >= 0xDC00 && code <= 0xDFFF) return fail();
+            // Символы вне BMP приходят суррогатной парой
+            if (code >= 0xD800 && code <= 0xDBFF) {
+                unsigned int low;
+                if (in.size() - pos < 2 || in[pos] != '\\' || in[pos + 1] != 'u') return fail();
+                pos += 2;
+                if (!read_hex4(low) || low < 0xDC00 || low > 0xDFFF) return fail();
+                code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+            }
+            append_utf8(out, code);
+            break;
+        }
+        default:
+            return fail();
+        }
+        run = pos;
+    }
+}
+
+bool JsonReader::read_string(std::string& out) {
+    if (failed) return false;
+    return parse_string(out);
+}
+
+bool JsonReader::read_int(long long& value) {
+    if (failed) return false;
+    skip_ws();
+    size_t start = pos;
+    if (!skip_number()) return false;
+
+    // Дробные числа и экспонента для целых полей не подходят
+    std::string_view text = in.substr(start, pos - start);
+    if (text.find_first_of(".eE") != std::string_view::npos) return fail();
+    auto result = std::from_chars(text.data(), text.data() + text.size(), value);
+    if (result.ec != std::errc() || result.ptr != text.data() + text.size()) return fail();
+    return true;
+}
+
+bool JsonReader::read_bool(bool& value) {
+    if (failed) return false;
+    skip_ws();
+    if (in.substr(pos, 4) == "true") {
+        value = true;
+        pos += 4;
+        return true;
+    }
+    if (in.substr(pos, 5) == "false") {
+        value = false;
+        pos += 5;
+        return true;
+    }
+    return fail();
+}
+
+bool JsonReader::skip_literal(std::string_view literal) {
+    if (in.substr(pos, literal.size()) != literal) return fail();
+    pos += literal.size();
+    return true;
+}
+
+// Число по грамматике JSON: -?(0|[1-9]\d*)(\.\d+)?([eE][+-]?\d+)?
+bool JsonReader::skip_number() {
+    auto digits = [this]() {
+        size_t start = pos;
+        while (pos < in.size() && in[pos] >= '0' && in[pos] <= '9') pos++;
+        return pos > start;
+    };
+
+    if (pos < in.size() && in[pos] == '-') pos++;
+    if (pos < in.size() && in[pos] == '0') {
+        pos++;
+    }
+    else if (!digits()) {
+        return fail();
+    }
+    if (pos < in.size() && in[pos] == '.') {
+        pos++;
+        if (!digits()) return fail();
+    }
+    if (pos < in.size() && (in[pos] == 'e' || in[pos] == 'E')) {
+        pos++;
+        if (pos < in.size() && (in[pos] == '+' || in[pos] == '-')) pos++;
+        if (!digits()) return fail();
+    }
+    return true;
+}
+
+bool JsonReader::skip_value() {
+    if (failed) return false;
+    skip_ws();
+    if (pos >= in.size()) return fail();
+
+    switch (in[pos]) {
+    case '"':
+        return parse_string(scratch);
+    case '{': {
+        if (!begin_object()) return false;
+        std::string_view key;
+        while (next_key(key)) {
+            if (!skip_value()) return false;
+        }
+        return ok();
+    }
+    case '[':
+        if (!begin_array()) return false;
+        while (next_element()) {
+            if (!skip_value()) return false;
+        }
+        return ok();
+    case 't': return skip_literal("true");
+    case 'f': return skip_literal("false");
+    case 'n': return skip_literal("null");
+    default: return skip_number();
+    }
+}
+
+bool JsonReader::finish() {
+    if (failed || depth != 0) return false;
+    skip_ws();
+    return pos == in.size();
+}
\ No newline at end of file
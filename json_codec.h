@@ -0,0 +1,76 @@
+#pragma once
+#ifndef JSON_CODEC_H
+#define JSON_CODEC_H
+
+#include <string>
+#include <string_view>
+#include <memory_resource>
+
+// Дописывает s в out как JSON-строку в кавычках. Кавычки, обратная косая черта
+// и управляющие символы экранируются, корректный UTF-8 копируется как есть,
+// некорректные байты заменяются на U+FFFD
+void json_append_string(std::string& out, std::string_view s);
+void json_append_int(std::string& out, long long value);
+// То же для строк в памяти запроса (тело ответа httplib::Response)
+void json_append_string(std::pmr::string& out, std::string_view s);
+void json_append_int(std::pmr::string& out, long long value);
+
+// Однопроходный разбор JSON без построения дерева. Значения читаются по мере
+// обхода, строки без escape-последовательностей копируются одним куском.
+//
+//     JsonReader reader(body);
+//     std::string_view key;
+//     if (reader.begin_object()) {
+//         while (reader.next_key(key)) {
+//             if (key == "title") reader.read_string(title);
+//             else reader.skip_value();
+//         }
+//     }
+//     if (!reader.finish()) ...ошибка...
+//
+// После первой ошибки все методы возвращают false, ok() - тоже.
+class JsonReader {
+public:
+    explicit JsonReader(std::string_view input) : in(input) {}
+
+    bool begin_object();
+    // Переходит к следующему ключу; false - объект закончился (или ошибка, см. ok()).
+    // key действителен до следующего вызова next_key
+    bool next_key(std::string_view& key);
+
+    bool begin_array();
+    // Переходит к следующему элементу; false - массив закончился (или ошибка)
+    bool next_element();
+
+    bool read_string(std::string& out);
+    bool read_int(long long& value);
+    bool read_bool(bool& value);
+    // Пропускает значение любого типа, включая вложенные объекты и массивы
+    bool skip_value();
+    // Проверяет, что разбор прошел без ошибок и после значения только пробелы
+    bool finish();
+
+    bool ok() const { return !failed; }
+
+private:
+    static const int max_depth = 64;
+
+    bool fail();
+    void skip_ws();
+    bool expect(char c);
+    bool parse_string(std::string& out);
+    bool skip_literal(std::string_view literal);
+    bool skip_number();
+    bool open(char c);
+    bool next_in_container(char close);
+
+    std::string_view in;
+    size_t pos = 0;
+    bool failed = false;
+    int depth = 0;
+    bool first[max_depth] = {};  // не было ли еще элементов в открытом контейнере
+    std::string key_buffer;
+    std::string scratch;  // пропускаемые строки
+};
+
+#endif
\ No newline at end of file
@@ -0,0 +1,474 @@
+﻿// Генератор HTTP-нагрузки для запущенного сервера. Каждое соединение -
+// отдельный поток с keep-alive; в конце печатаются пропускная способность
+// и задержки p50/p99/p999.
+//
+//   loadgen [--host 127.0.0.1] [--port 8080] [--connections 8] [--duration 10]
+//           [--rate R] [--workload FILE] [--seed N]
+//
+// --rate задает открытую нагрузку: R запросов в секунду на все соединения,
+// задержка считается от запланированного момента отправки, поэтому очередь
+// из-за медленного сервера в нее попадает. Без --rate - замкнутый цикл:
+// следующий запрос уходит сразу после ответа на предыдущий.
+//
+// Нагрузка без --workload: --seed задач создается заранее, затем 80% GET /tasks/{id},
+// 15% PATCH /tasks/{id} по этим задачам и 5% POST /tasks (при --seed 0 - только POST). --workload - файл JSON-строк, по одному
+// запросу на строку, соединения проходят его по кругу:
+//   {"method":"GET","path":"/tasks/1"}
+//   {"method":"POST","path":"/tasks","body":"{\"title\":\"a\"}"}   (тело - строка)
+// Строка без "path", но с "title" (например, из requests.jsonl) становится
+// POST /tasks с этим заголовком и описанием из "description" или "body".
+#include "json_codec.h"
+#include "httplib.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+    using Clock = std::chrono::steady_clock;
+    using httplib::socket_t;
+
+    struct Options {
+        std::string host = "127.0.0.1";
+        int port = 8080;
+        size_t connections = 8;
+        double duration = 10;
+        double rate = 0;  // 0 - замкнутый цикл
+        std::string workload;
+        int seed = 1000;
+    };
+
+    std::string make_request(const Options& options, std::string_view method, std::string_view path,
+        std::string_view body) {
+        std::string out;
+        out.reserve(128 + body.size());
+        out.append(method).append(" ").append(path).append(" HTTP/1.1\r\n");
+        out += "Host: " + options.host + ":" + std::to_string(options.port) + "\r\n";
+        if (!body.empty()) {
+            out += "Content-Type: application/json\r\n";
+            out += "Content-Length: " + std::to_string(body.size()) + "\r\n";
+        }
+        out += "\r\n";
+        out.append(body);
+        return out;
+    }
+
+    std::string task_body(std::string_view title, std::string_view description) {
+        std::string body = "{\"title\":";
+        json_append_string(body, title);
+        body += ",\"description\":";
+        json_append_string(body, description);
+        body += "}";
+        return body;
+    }
+
+    // Разбирает файл нагрузки в готовые тексты запросов; некорректные строки
+    // пропускаются с предупреждением
+    bool load_workload(const Options& options, std::vector<std::string>& requests) {
+        std::ifstream file(options.workload, std::ios::binary);
+        if (!file) {
+            std::fprintf(stderr, "Не удалось открыть %s\n", options.workload.c_str());
+            return false;
+        }
+        std::string line;
+        size_t line_number = 0;
+        while (std::getline(file, line)) {
+            line_number++;
+            if (!line.empty() && line.back() == '\r') line.pop_back();
+            if (line.find_first_not_of(" \t") == std::string::npos) continue;
+
+            JsonReader reader(line);
+            std::string_view key;
+            std::string method, path, body, title, description;
+            bool valid = reader.begin_object();
+            while (valid && reader.next_key(key)) {
+                if (key == "method") valid = reader.read_string(method);
+                else if (key == "path") valid = reader.read_string(path);
+                else if (key == "body") valid = reader.read_string(body);
+                else if (key == "title") valid = reader.read_string(title);
+                else if (key == "description") valid = reader.read_string(description);
+                else valid = reader.skip_value();
+            }
+            if (!valid || !reader.finish() || (path.empty() && title.empty())) {
+                std::fprintf(stderr, "%s:%zu: строка пропущена\n", options.workload.c_str(), line_number);
+                continue;
+            }
+
+            if (path.empty()) {
+                requests.push_back(make_request(options, "POST", "/tasks",
+                    task_body(title, description.empty() ? body : description)));
+            }
+            else {
+                requests.push_back(make_request(options, method.empty() ? "GET" : method, path, body));
+            }
+        }
+        return true;
+    }
+
+    // Соединение клиента: блокирующий сокет и непрочитанный остаток ответа
+    class Connection {
+    public:
+        explicit Connection(const Options& options) : options(options) {}
+
+        ~Connection() {
+            close();
+        }
+
+        bool connected() const {
+            return fd != httplib::invalid_socket;
+        }
+
+        bool open() {
+            close();
+            fd = socket(AF_INET, SOCK_STREAM, 0);
+            if (fd == httplib::invalid_socket) return false;
+
+            sockaddr_in address{};
+            address.sin_family = AF_INET;
+            address.sin_port = htons((uint16_t)options.port);
+            std::string host = options.host == "localhost" ? "127.0.0.1" : options.host;
+            if (inet_pton(AF_INET, host.c_str(), &address.sin_addr) != 1 ||
+                connect(fd, (sockaddr*)&address, sizeof(address)) < 0) {
+                close();
+                return false;
+            }
+            int opt = 1;
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, (const char*)&opt, sizeof(opt));
+            return true;
+        }
+
+        void close() {
+            if (connected()) httplib::detail::close_socket(fd);
+            fd = httplib::invalid_socket;
+            in.clear();
+        }
+
+        // Отправляет запрос и читает ответ целиком. Возвращает код статуса или -1.
+        // Тело ответа копируется в body, если он передан
+        int exchange(const std::string& request, std::string* body = nullptr) {
+            if (!connected() && !open()) return -1;
+            if (!send_all(request)) {
+                close();
+                return -1;
+            }
+            if (body) body->clear();
+            int status = read_response(body);
+            if (status < 0 || close_after) close();
+            return status;
+        }
+
+    private:
+        bool send_all(std::string_view data) {
+            while (!data.empty()) {
+                auto n = send(fd, data.data(), (int)data.size(), 0);
+                if (n <= 0) return false;
+                data.remove_prefix(n);
+            }
+            return true;
+        }
+
+        // Дочитывает в in, пока в нем меньше size байт
+        bool fill(size_t size) {
+            char buffer[16384];
+            while (in.size() < size) {
+                auto n = recv(fd, buffer, sizeof(buffer), 0);
+                if (n <= 0) return false;
+                in.append(buffer, n);
+            }
+            return true;
+        }
+
+        // Позиция конца строки (\r\n), начиная с from; дочитывает при необходимости
+        size_t find_line(size_t from) {
+            for (;;) {
+                size_t eol = in.find("\r\n", from);
+                if (eol != std::string::npos) return eol;
+                if (!fill(in.size() + 1)) return std::string::npos;
+            }
+        }
+
+        int read_response(std::string* out) {
+            size_t header_end;
+            for (;;) {
+                header_end = in.find("\r\n\r\n");
+                if (header_end != std::string::npos) break;
+                if (!fill(in.size() + 1)) return -1;
+            }
+
+            std::string_view head(in.data(), header_end);
+            if (head.size() < 12 || head.substr(0, 5) != "HTTP/") return -1;
+            int status = std::atoi(std::string(head.substr(9, 3)).c_str());
+
+            size_t content_length = 0;
+            bool chunked = false;
+            close_after = false;
+            size_t pos = head.find("\r\n");
+            while (pos != std::string_view::npos) {
+                size_t next = head.find("\r\n", pos + 2);
+                std::string_view line = head.substr(pos + 2, next == std::string_view::npos ? next : next - pos - 2);
+                size_t colon = line.find(':');
+                if (colon != std::string_view::npos) {
+                    std::string_view name = line.substr(0, colon);
+                    std::string_view value = line.substr(colon + 1);
+                    while (!value.empty() && value.front() == ' ') value.remove_prefix(1);
+                    if (httplib::detail::iequals(name, "Content-Length")) {
+                        content_length = std::strtoull(std::string(value).c_str(), nullptr, 10);
+                    }
+                    else if (httplib::detail::iequals(name, "Transfer-Encoding")) {
+                        chunked = httplib::detail::iequals(value, "chunked");
+                    }
+                    else if (httplib::detail::iequals(name, "Connection")) {
+                        close_after = httplib::detail::iequals(value, "close");
+                    }
+                }
+                pos = next;
+            }
+
+            size_t body = header_end + 4;
+            if (!chunked) {
+                if (!fill(body + content_length)) return -1;
+                if (out) out->assign(in, body, content_length);
+                in.erase(0, body + content_length);
+                return status;
+            }
+
+            // Тело по частям: размер строкой в hex, данные, \r\n; последний чанк нулевой
+            for (;;) {
+                size_t eol = find_line(body);
+                if (eol == std::string::npos) return -1;
+                size_t size = std::strtoull(in.substr(body, eol - body).c_str(), nullptr, 16);
+                if (size == 0) {
+                    size_t end = find_line(eol + 2);
+                    if (end == std::string::npos) return -1;
+                    in.erase(0, end + 2);
+                    return status;
+                }
+                if (!fill(eol + 2 + size + 2)) return -1;
+                if (out) out->append(in, eol + 2, size);
+                body = eol + 2 + size + 2;
+            }
+        }
+
+        const Options& options;
+        socket_t fd = httplib::invalid_socket;
+        std::string in;
+        bool close_after = false;
+    };
+
+    // Результаты одного потока
+    struct Stats {
+        std::vector<uint64_t> latencies_ns;
+        size_t by_class[6] = {};  // [1..5] - 1xx..5xx, [0] - ошибки соединения
+    };
+
+    // Встроенная смешанная нагрузка по заранее созданным задачам. id берутся
+    // из ответа сервера на их создание: в непустом хранилище они не начинаются с 1
+    class MixedWorkload {
+    public:
+        MixedWorkload(const Options& options, const std::vector<int>& ids, size_t thread_index)
+            : options(options), ids(ids), rng((unsigned)(thread_index * 7919 + 1)) {}
+
+        const std::string& next() {
+            int kind = ids.empty() ? 100 : (int)(rng() % 100);
+            if (kind < 80) {
+                current = make_request(options, "GET", "/tasks/" + std::to_string(any_id()), "");
+            }
+            else if (kind < 95) {
+                static const char* const statuses[] = { "todo", "in_progress", "done" };
+                current = make_request(options, "PATCH", "/tasks/" + std::to_string(any_id()),
+                    std::string("{\"status\":\"") + statuses[rng() % 3] + "\"}");
+            }
+            else {
+                current = make_request(options, "POST", "/tasks", task_body("loadgen", "создано генератором нагрузки"));
+            }
+            return current;
+        }
+
+    private:
+        int any_id() { return ids[rng() % ids.size()]; }
+
+        const Options& options;
+        const std::vector<int>& ids;
+        std::mt19937 rng;
+        std::string current;
+    };
+
+    void run_connection(const Options& options, const std::vector<std::string>& workload,
+        const std::vector<int>& ids, size_t index, Clock::time_point start, Clock::time_point end, Stats& stats) {
+        Connection connection(options);
+        MixedWorkload mixed(options, ids, index);
+        size_t position = workload.empty() ? 0 : index * workload.size() / options.connections;
+
+        // При открытой нагрузке соединения сдвинуты друг относительно друга на долю интервала
+        std::chrono::nanoseconds interval(0);
+        Clock::time_point scheduled = start;
+        if (options.rate > 0) {
+            interval = std::chrono::nanoseconds((int64_t)(1e9 * options.connections / options.rate));
+            scheduled += interval * index / options.connections;
+        }
+
+        for (;;) {
+            if (options.rate > 0) {
+                if (scheduled >= end) break;
+                std::this_thread::sleep_until(scheduled);
+            }
+            else {
+                scheduled = Clock::now();
+                if (scheduled >= end) break;
+            }
+
+            const std::string& request = workload.empty() ? mixed.next() : workload[position++ % workload.size()];
+            int status = connection.exchange(request);
+            auto done = Clock::now();
+
+            // Задержка только по полученным ответам: время переподключения
+            // и паузы после ошибки не должны попадать в перцентили
+            if (status >= 0) {
+                stats.latencies_ns.push_back((uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(done - scheduled).count());
+            }
+            stats.by_class[status >= 100 && status < 600 ? status / 100 : 0]++;
+            if (status < 0 && options.rate <= 0) {
+                // Сервер недоступен: не крутимся вхолостую
+                std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            }
+            scheduled += interval;
+        }
+    }
+
+    // id созданных задач из ответа POST /tasks:batch: [{"status":201,"task":{"id":N,...}},...]
+    bool read_created_ids(std::string_view json, std::vector<int>& ids) {
+        JsonReader reader(json);
+        std::string_view key;
+        if (!reader.begin_array()) return false;
+        while (reader.next_element()) {
+            if (!reader.begin_object()) return false;
+            while (reader.next_key(key)) {
+                if (key != "task") {
+                    reader.skip_value();
+                    continue;
+                }
+                if (!reader.begin_object()) return false;
+                while (reader.next_key(key)) {
+                    long long id = 0;
+                    if (key == "id" && reader.read_int(id)) ids.push_back((int)id);
+                    else if (key != "id") reader.skip_value();
+                }
+            }
+        }
+        return reader.finish();
+    }
+
+    // Заранее создает задачи для встроенной нагрузки и собирает их id
+    bool seed_tasks(const Options& options, std::vector<int>& ids) {
+        Connection connection(options);
+        std::string response;
+        const int batch = 1000;
+        for (int created = 0; created < options.seed; created += batch) {
+            int count = std::min(batch, options.seed - created);
+            std::string body = "[";
+            for (int i = 0; i < count; i++) {
+                if (i > 0) body += ",";
+                body += task_body("Задача " + std::to_string(created + i + 1), "начальные данные");
+            }
+            body += "]";
+            if (connection.exchange(make_request(options, "POST", "/tasks:batch", body), &response) != 200) return false;
+            if (!read_created_ids(response, ids)) return false;
+        }
+        return true;
+    }
+
+    double percentile_us(const std::vector<uint64_t>& sorted, double p) {
+        if (sorted.empty()) return 0;
+        size_t index = std::min(sorted.size() - 1, (size_t)(p * sorted.size()));
+        return sorted[index] / 1000.0;
+    }
+
+    void usage(const char* program) {
+        std::fprintf(stderr,
+            "Использование: %s [--host H] [--port P] [--connections N] [--duration S]\n"
+            "               [--rate R] [--workload FILE] [--seed N]\n", program);
+    }
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    Options options;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool has_value = i + 1 < argc;
+        if (arg == "--host" && has_value) options.host = argv[++i];
+        else if (arg == "--port" && has_value) options.port = std::atoi(argv[++i]);
+        else if (arg == "--connections" && has_value) options.connections = std::max(1, std::atoi(argv[++i]));
+        else if (arg == "--duration" && has_value) options.duration = std::atof(argv[++i]);
+        else if (arg == "--rate" && has_value) options.rate = std::atof(argv[++i]);
+        else if (arg == "--workload" && has_value) options.workload = argv[++i];
+        else if (arg == "--seed" && has_value) options.seed = std::atoi(argv[++i]);
+        else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+#ifdef _WIN32
+    WSADATA wsaData;
+    WSAStartup(MAKEWORD(2, 2), &wsaData);
+#endif
+
+    std::vector<std::string> workload;
+    std::vector<int> ids;
+    if (!options.workload.empty()) {
+        if (!load_workload(options, workload)) return 1;
+        if (workload.empty()) {
+            std::fprintf(stderr, "В %s нет запросов\n", options.workload.c_str());
+            return 1;
+        }
+    }
+    else if (options.seed > 0 && !seed_tasks(options, ids)) {
+        std::fprintf(stderr, "Не удалось создать начальные задачи на %s:%d\n", options.host.c_str(), options.port);
+        return 1;
+    }
+
+    std::printf("%s:%d, соединений: %zu, %s, %.1f с\n", options.host.c_str(), options.port,
+        options.connections,
+        options.rate > 0 ? ("открытая нагрузка " + std::to_string((long long)options.rate) + " запр/с").c_str()
+        : "замкнутый цикл",
+        options.duration);
+
+    std::vector<Stats> stats(options.connections);
+    std::vector<std::thread> threads;
+    auto start = Clock::now();
+    auto end = start + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(options.duration));
+    for (size_t i = 0; i < options.connections; i++) {
+        threads.emplace_back([&, i]() { run_connection(options, workload, ids, i, start, end, stats[i]); });
+    }
+    for (auto& t : threads) t.join();
+    double elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+
+    Stats total;
+    for (auto& s : stats) {
+        total.latencies_ns.insert(total.latencies_ns.end(), s.latencies_ns.begin(), s.latencies_ns.end());
+        for (int c = 0; c < 6; c++) total.by_class[c] += s.by_class[c];
+    }
+    std::sort(total.latencies_ns.begin(), total.latencies_ns.end());
+    auto& lat = total.latencies_ns;
+
+    std::printf("Запросов: %zu за %.2f с, %.1f запр/с\n", lat.size(), elapsed, lat.size() / elapsed);
+    std::printf("Ответы: 2xx %zu, 3xx %zu, 4xx %zu, 5xx %zu, ошибок соединения %zu\n",
+        total.by_class[2], total.by_class[3], total.by_class[4], total.by_class[5], total.by_class[0]);
+    std::printf("Задержка, мкс: p50 %.1f  p99 %.1f  p999 %.1f  max %.1f\n",
+        percentile_us(lat, 0.50), percentile_us(lat, 0.99), percentile_us(lat, 0.999),
+        lat.empty() ? 0.0 : lat.back() / 1000.0);
+
+#ifdef _WIN32
+    WSACleanup();
+#endif
+    return 0;
+}
\ No newline at end of file
@@ -0,0 +1,346 @@
+#include "logger.h"
+#include "json_codec.h"
+#include <filesystem>
+#include <algorithm>
+#include <cstring>
+#include <ctime>
+
+#ifdef _WIN32
+#include <io.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/uio.h>
+#include <sys/stat.h>
+#include <climits>
+#endif
+
+namespace fs = std::filesystem;
+
+std::atomic<uint64_t> Logger::next_instance_id{ 1 };
+
+namespace {
+
+    // Двоичная запись в буфере потока: заголовок, за ним length байт текста
+    struct RecordHeader {
+        int64_t timestamp_ns;  // от начала эпохи, UTC
+        int32_t task_id;
+        uint16_t length;
+        uint8_t level;
+        uint8_t reserved;
+    };
+
+    const char* level_name(uint8_t level) {
+        switch ((LogLevel)level) {
+        case LogLevel::Debug: return "debug";
+        case LogLevel::Info: return "info";
+        case LogLevel::Warn: return "warn";
+        case LogLevel::Error: return "error";
+        default: return "info";
+        }
+    }
+
+#ifdef _WIN32
+    int open_append(const std::string& path) {
+        return _open(path.c_str(), _O_WRONLY | _O_CREAT | _O_APPEND | _O_BINARY, _S_IREAD | _S_IWRITE);
+    }
+
+    void close_file(int fd) { _close(fd); }
+#else
+    int open_append(const std::string& path) {
+        return open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    }
+
+    void close_file(int fd) { close(fd); }
+#endif
+
+} // namespace
+
+// Кольцевой буфер байтов с одним писателем (поток-владелец) и одним читателем
+// (фоновый поток). head и tail только растут, позиция в буфере - по маске
+struct Logger::ThreadBuffer {
+    ThreadBuffer(size_t requested, int index) : thread_index(index) {
+        size_t size = 4096;
+        while (size < requested) size <<= 1;
+        data.reset(new char[size]);
+        mask = size - 1;
+    }
+
+    size_t capacity() const { return mask + 1; }
+
+    void copy_in(size_t pos, const void* src, size_t size) {
+        size_t offset = pos & mask;
+        size_t first = std::min(size, capacity() - offset);
+        memcpy(data.get() + offset, src, first);
+        memcpy(data.get(), static_cast<const char*>(src) + first, size - first);
+    }
+
+    void copy_out(size_t pos, void* dst, size_t size) const {
+        size_t offset = pos & mask;
+        size_t first = std::min(size, capacity() - offset);
+        memcpy(dst, data.get() + offset, first);
+        memcpy(static_cast<char*>(dst) + first, data.get(), size - first);
+    }
+
+    std::unique_ptr<char[]> data;
+    size_t mask = 0;
+    alignas(64) std::atomic<size_t> head{ 0 };  // пишет владелец
+    alignas(64) std::atomic<size_t> tail{ 0 };  // читает фоновый поток
+    int thread_index;
+    std::string chunk;  // JSON-строки этого буфера, собранные для очередного writev
+};
+
+Logger::Logger() = default;
+
+Logger::~Logger() {
+    stop();
+}
+
+bool Logger::parse_level(std::string_view name, LogLevel& level) {
+    if (name == "debug") level = LogLevel::Debug;
+    else if (name == "info") level = LogLevel::Info;
+    else if (name == "warn") level = LogLevel::Warn;
+    else if (name == "error") level = LogLevel::Error;
+    else return false;
+    return true;
+}
+
+bool Logger::start(const LoggerOptions& opts) {
+    if (running) return true;
+    options = opts;
+    set_level(options.level);
+    if (!open_output()) return false;
+
+    running = true;
+    flusher = std::thread([this]() { flusher_loop(); });
+    return true;
+}
+
+void Logger::stop() {
+    if (!running.exchange(false)) return;
+    {
+        std::lock_guard<std::mutex> lock(flusher_mtx);
+        flusher_cv.notify_all();
+    }
+    flusher.join();
+    flush();
+    if (own_fd) close_file(fd);
+    fd = -1;
+}
+
+// Буфер текущего потока для этого логгера; создается при первой записи.
+// Кэш потока хранит номер логгера, а не только указатель, поэтому буфер
+// удаленного логгера никогда не будет использован повторно
+Logger::ThreadBuffer* Logger::local_buffer() {
+    struct CacheEntry {
+        uint64_t logger_id;
+        ThreadBuffer* buffer;
+    };
+    thread_local std::vector<CacheEntry> cache;
+
+    for (const CacheEntry& entry : cache) {
+        if (entry.logger_id == instance_id) return entry.buffer;
+    }
+
+    std::lock_guard<std::mutex> lock(buffers_mtx);
+    buffers.emplace_back(new ThreadBuffer(options.thread_buffer_bytes, (int)buffers.size() + 1));
+    ThreadBuffer* buffer = buffers.back().get();
+    cache.push_back({ instance_id, buffer });
+    return buffer;
+}
+
+void Logger::write(LogLevel level, std::string_view message, int task_id) {
+    if (!enabled(level)) return;
+
+    ThreadBuffer* buffer = local_buffer();
+    size_t max_length = std::min<size_t>(UINT16_MAX, buffer->capacity() / 4);
+    size_t length = std::min(message.size(), max_length);
+    size_t need = sizeof(RecordHeader) + length;
+
+    size_t head = buffer->head.load(std::memory_order_relaxed);
+    size_t tail = buffer->tail.load(std::memory_order_acquire);
+    if (buffer->capacity() - (head - tail) < need) {
+        dropped_count.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    RecordHeader header;
+    header.timestamp_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+    header.task_id = task_id;
+    header.length = (uint16_t)length;
+    header.level = (uint8_t)level;
+    header.reserved = 0;
+
+    buffer->copy_in(head, &header, sizeof(header));
+    buffer->copy_in(head + sizeof(header), message.data(), length);
+    buffer->head.store(head + need, std::memory_order_release);
+}
+
+void Logger::flusher_loop() {
+    std::unique_lock<std::mutex> lock(flusher_mtx);
+    while (running) {
+        flusher_cv.wait_for(lock, options.flush_interval);
+        lock.unlock();
+        flush();
+        lock.lock();
+    }
+}
+
+// Забирает записи из всех буферов и выводит их одним writev
+bool Logger::flush() {
+    std::vector<ThreadBuffer*> snapshot;
+    {
+        std::lock_guard<std::mutex> lock(buffers_mtx);
+        for (auto& buffer : buffers) snapshot.push_back(buffer.get());
+    }
+
+    // Секунды форматируются один раз и переиспользуются, пока не сменятся
+    static thread_local int64_t cached_second = -1;
+    static thread_local char cached_time[32];
+
+    std::vector<std::string*> chunks;
+    std::string message;
+    size_t total = 0;
+    for (ThreadBuffer* buffer : snapshot) {
+        size_t head = buffer->head.load(std::memory_order_acquire);
+        size_t tail = buffer->tail.load(std::memory_order_relaxed);
+        if (head == tail) continue;
+
+        std::string& out = buffer->chunk;
+        out.clear();
+        while (tail < head) {
+            RecordHeader header;
+            buffer->copy_out(tail, &header, sizeof(header));
+            message.resize(header.length);
+            buffer->copy_out(tail + sizeof(header), &message[0], header.length);
+            tail += sizeof(header) + header.length;
+
+            int64_t second = header.timestamp_ns / 1000000000;
+            if (second != cached_second) {
+                std::time_t t = (std::time_t)second;
+                std::tm tm;
+#ifdef _WIN32
+                gmtime_s(&tm, &t);
+#else
+                gmtime_r(&t, &tm);
+#endif
+                strftime(cached_time, sizeof(cached_time), "%Y-%m-%dT%H:%M:%S", &tm);
+                cached_second = second;
+            }
+            char millis[8];
+            snprintf(millis, sizeof(millis), ".%03dZ", (int)(header.timestamp_ns / 1000000 % 1000));
+
+            out += "{\"ts\":\"";
+            out += cached_time;
+            out += millis;
+            out += "\",\"level\":\"";
+            out += level_name(header.level);
+            out += "\",\"thread\":";
+            json_append_int(out, buffer->thread_index);
+            if (header.task_id != 0) {
+                out += ",\"task_id\":";
+                json_append_int(out, header.task_id);
+            }
+            out += ",\"msg\":";
+            json_append_string(out, message);
+            out += "}\n";
+        }
+        buffer->tail.store(tail, std::memory_order_release);
+
+        chunks.push_back(&out);
+        total += out.size();
+    }
+
+    if (chunks.empty()) return true;
+    return write_out(chunks, total);
+}
+
+bool Logger::write_out(const std::vector<std::string*>& chunks, size_t total) {
+    if (fd < 0) return false;
+    if (own_fd && file_size > 0 && file_size + total > options.max_file_bytes) {
+        rotate();
+        if (fd < 0) return false;
+    }
+    file_size += total;
+
+#ifdef _WIN32
+    for (const std::string* chunk : chunks) {
+        const char* data = chunk->data();
+        size_t size = chunk->size();
+        while (size > 0) {
+            int n = _write(fd, data, (unsigned int)std::min<size_t>(size, 1 << 30));
+            if (n <= 0) return false;
+            data += n;
+            size -= n;
+        }
+    }
+    return true;
+#else
+    std::vector<iovec> iov(chunks.size());
+    for (size_t i = 0; i < chunks.size(); i++) {
+        iov[i].iov_base = const_cast<char*>(chunks[i]->data());
+        iov[i].iov_len = chunks[i]->size();
+    }
+
+    // writev может записать только часть: сдвигаемся и продолжаем
+    size_t index = 0;
+    while (index < iov.size()) {
+        int count = (int)std::min<size_t>(iov.size() - index, IOV_MAX);
+        ssize_t n = writev(fd, &iov[index], count);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+
+        size_t written = (size_t)n;
+        while (index < iov.size() && written >= iov[index].iov_len) {
+            written -= iov[index].iov_len;
+            index++;
+        }
+        if (index < iov.size()) {
+            iov[index].iov_base = static_cast<char*>(iov[index].iov_base) + written;
+            iov[index].iov_len -= written;
+        }
+    }
+    return true;
+#endif
+}
+
+bool Logger::open_output() {
+    if (options.path.empty()) {
+        fd = 1;  // stdout
+        own_fd = false;
+        return true;
+    }
+
+    fd = open_append(options.path);
+    if (fd < 0) return false;
+    own_fd = true;
+
+    std::error_code ec;
+    auto size = fs::file_size(options.path, ec);
+    file_size = ec ? 0 : (size_t)size;
+    return true;
+}
+
+// path -> path.1 -> path.2 ... -> path.<max_files>, самый старый удаляется
+void Logger::rotate() {
+    close_file(fd);
+    fd = -1;
+
+    std::error_code ec;
+    if (options.max_files <= 0) {
+        fs::remove(options.path, ec);
+    }
+    else {
+        fs::remove(options.path + "." + std::to_string(options.max_files), ec);
+        for (int i = options.max_files - 1; i >= 1; i--) {
+            fs::rename(options.path + "." + std::to_string(i), options.path + "." + std::to_string(i + 1), ec);
+        }
+        fs::rename(options.path, options.path + ".1", ec);
+    }
+
+    fd = open_append(options.path);
+    file_size = 0;
+}
\ No newline at end of file
@@ -0,0 +1,90 @@
+#pragma once
+#ifndef LOGGER_H
+#define LOGGER_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+enum class LogLevel : uint8_t { Debug, Info, Warn, Error };
+
+struct LoggerOptions {
+    std::string path;                           // пусто - stdout
+    LogLevel level = LogLevel::Info;            // записи ниже этого уровня не пишутся
+    size_t max_file_bytes = 64 * 1024 * 1024;   // после этого размера файл ротируется
+    int max_files = 5;                          // сколько старых файлов (path.1 ... path.N) хранить
+    size_t thread_buffer_bytes = 64 * 1024;     // буфер записей каждого потока
+    std::chrono::milliseconds flush_interval{ 20 };
+};
+
+// Асинхронный логгер. Поток, который пишет запись, только копирует ее в свой
+// заранее выделенный кольцевой буфер в двоичном виде (заголовок + текст) и
+// никогда не ждет вывода: если буфер полон, запись отбрасывается и учитывается
+// в dropped(). Фоновый поток раз в flush_interval забирает записи из всех
+// буферов, превращает их в JSON-строки и выводит одним writev.
+//
+//     {"ts":"2024-05-01T12:00:00.123Z","level":"info","thread":3,"task_id":7,"msg":"..."}
+class Logger {
+public:
+    Logger();
+    ~Logger();
+
+    Logger(const Logger&) = delete;
+    Logger& operator=(const Logger&) = delete;
+
+    // Открывает вывод и запускает фоновый поток. false - файл не открылся
+    bool start(const LoggerOptions& options);
+    // Выводит все накопленные записи и останавливает фоновый поток
+    void stop();
+
+    bool enabled(LogLevel level) const {
+        return (uint8_t)level >= min_level.load(std::memory_order_relaxed);
+    }
+    void set_level(LogLevel level) { min_level.store((uint8_t)level, std::memory_order_relaxed); }
+
+    // task_id = 0 - запись не относится к задаче
+    void write(LogLevel level, std::string_view message, int task_id = 0);
+
+    uint64_t dropped() const { return dropped_count.load(std::memory_order_relaxed); }
+
+    static bool parse_level(std::string_view name, LogLevel& level);
+
+private:
+    struct ThreadBuffer;
+
+    ThreadBuffer* local_buffer();
+    void flusher_loop();
+    bool flush();
+    bool write_out(const std::vector<std::string*>& chunks, size_t total);
+    bool open_output();
+    void rotate();
+
+    LoggerOptions options;
+    std::atomic<uint8_t> min_level{ (uint8_t)LogLevel::Info };
+    std::atomic<bool> running{ false };
+    std::atomic<uint64_t> dropped_count{ 0 };
+
+    // Буферы всех потоков, когда-либо писавших в лог. Буфер живет, пока жив логгер
+    std::mutex buffers_mtx;
+    std::vector<std::unique_ptr<ThreadBuffer>> buffers;
+    // Уникальный номер логгера, чтобы потоковый кэш не перепутал экземпляры
+    uint64_t instance_id = next_instance_id.fetch_add(1);
+    static std::atomic<uint64_t> next_instance_id;
+
+    int fd = -1;
+    bool own_fd = false;
+    size_t file_size = 0;
+
+    std::thread flusher;
+    std::mutex flusher_mtx;
+    std::condition_variable flusher_cv;
+};
+
+#endif
\ No newline at end of file
@@ -1,287 +1,162 @@
-﻿#include "handler.h"
-#include "queue.h"
-#include "task.h"
-#include "httplib.h"
+﻿#include "routes.h"
 #include <iostream>
-#include <sstream>
 
 using namespace httplib;
 using namespace std;
 
-// Простая функция для логирования операций через очередь сообщений
-void log_operation(MessageQueue& mq, const string& operation) {
-    mq.push([operation]() {
-        cout << "[QUEUE LOG] " << operation << endl;
-        });
-}
-
-// Функция для создания JSON ошибки
-string create_error(const string& message) {
-    return "{\"error\":\"" + message + "\"}";
-}
-
-int main() {
-    setlocale (LC_ALL, "RUS");
-    cout << "=== To-Do API Server ===\n";
-
-    // Создаем очередь сообщений для логирования операций
-    MessageQueue log_queue;
-
-    // Запускаем обработку очереди логов в отдельном потоке
-    thread log_worker([&log_queue]() {
-        log_queue.run();
-        });
-
-    // Создаем менеджер задач (передаем ему очередь для демонстрации)
-    TaskManager manager(log_queue);
-
-    Server svr;
-
-    // ========== GET /tasks - все задачи ==========
-    svr.Get("/tasks", [&manager, &log_queue](const Request& req, Response& res) {
-        cout << "GET /tasks\n";
-        log_operation(log_queue, "GET /tasks - Получение всех задач");
-
-        auto tasks = manager.get_all_tasks();
-        string result = "[";
-        for (size_t i = 0; i < tasks.size(); i++) {
-            result += tasks[i].to_json();
-            if (i < tasks.size() - 1) result += ",";
+// Защита сервера от перегрузки
+struct ServerOptions {
+    string host = "localhost";
+    int port = 8080;
+    int rate_limit = 0;           // запросов в секунду с одного IP (0 - без ограничения)
+    int rate_burst = 0;           // запас подряд идущих запросов (0 - равен rate_limit)
+    int max_connections = 10000;  // открытых соединений, сверх - 503
+    int request_timeout_ms = 2000;  // сколько запрос может ждать обработки, дольше - 503
+    int compression_threshold = 1024;  // тела короче не сжимаются
+    int event_loops = 0;          // потоков epoll (0 - по числу ядер)
+    bool reuse_port = false;      // свой слушающий сокет у каждого потока
+    bool pin_cpus = false;        // закрепить потоки за ядрами
+};
+
+// Параметры из командной строки:
+//   --host <адрес>, --port N                  адрес и порт сервера (по умолчанию localhost:8080)
+//   --data <каталог>                          каталог WAL и снимков (по умолчанию data)
+//   --durability per-request|batched|async    когда запись считается сохраненной
+//   --in-memory                               не сохранять задачи на диск
+//   --log <файл>                              писать лог в файл с ротацией (по умолчанию stdout)
+//   --log-level debug|info|warn|error         минимальный уровень записей
+//   --rate-limit N, --rate-burst N            ограничение частоты запросов с одного IP
+//   --max-connections N                       ограничение числа соединений (0 - нет)
+//   --request-timeout <мс>                    допустимое ожидание запроса (0 - без ограничения)
+//   --compression-threshold <байт>            сжимать тела ответов не короче этого
+//   --event-loops N                           число потоков epoll (0 - по числу ядер)
+//   --reuse-port                              у каждого потока свой сокет SO_REUSEPORT
+//   --pin-cpus                                закрепить потоки epoll за ядрами
+bool parse_args(int argc, char* argv[], StorageOptions& options, LoggerOptions& log_options,
+    ServerOptions& server_options, bool& in_memory) {
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        if (arg == "--in-memory") {
+            in_memory = true;
         }
-        result += "]";
-        res.set_content(result, "application/json");
-        });
-
-    // ========== POST /tasks - создать задачу (СИНХРОННО) ==========
-    svr.Post("/tasks", [&manager, &log_queue](const Request& req, Response& res) {
-        cout << "POST /tasks\n";
-
-        if (req.body.empty()) {
-            res.status = 400;
-            res.set_content(create_error("Пустое тело запроса"), "application/json");
-            return;
+        else if (arg == "--host" && i + 1 < argc) {
+            server_options.host = argv[++i];
         }
-
-        try {
-            Task new_task = Task::from_json(req.body);
-
-            if (new_task.title.empty()) {
-                res.status = 400;
-                res.set_content(create_error("Заголовок задачи обязателен"), "application/json");
-                return;
-            }
-
-            // СИНХРОННО создаем задачу
-            int task_id = manager.create_task(new_task);
-            new_task.id = task_id;
-
-            res.status = 201;  // Created
-            res.set_content(new_task.to_json(), "application/json");
-
-            // Асинхронно логируем операцию через очередь
-            log_operation(log_queue, "POST /tasks - Создана задача #" + to_string(task_id));
-
-            cout << "  -> Создана задача #" << task_id << endl;
+        else if (arg == "--port" && i + 1 < argc) {
+            if (!parse_int(argv[++i], server_options.port) || server_options.port > 65535) return false;
         }
-        catch (const exception& e) {
-            res.status = 400;
-            res.set_content(create_error("Неверный JSON формат"), "application/json");
+        else if (arg == "--rate-limit" && i + 1 < argc) {
+            if (!parse_int(argv[++i], server_options.rate_limit)) return false;
         }
-        });
-
-    // ========== GET /tasks/{id} ==========
-    svr.Get(R"(/tasks/(\d+))", [&manager, &log_queue](const Request& req, Response& res) {
-        int task_id = stoi(req.matches[1]);
-        cout << "GET /tasks/" << task_id << "\n";
-        log_operation(log_queue, "GET /tasks/" + to_string(task_id) + " - Получение задачи");
-
-        Task task = manager.get_task_by_id(task_id);
-
-        if (task.id == 0) {
-            res.status = 404;
-            res.set_content(create_error("Задача не найдена"), "application/json");
-            return;
+        else if (arg == "--rate-burst" && i + 1 < argc) {
+            if (!parse_int(argv[++i], server_options.rate_burst)) return false;
         }
-
-        res.set_content(task.to_json(), "application/json");
-        });
-
-    // ========== PUT /tasks/{id} - обновить задачу (СИНХРОННО) ==========
-    svr.Put(R"(/tasks/(\d+))", [&manager, &log_queue](const Request& req, Response& res) {
-        int task_id = stoi(req.matches[1]);
-        cout << "PUT /tasks/" << task_id << "\n";
-
-        if (req.body.empty()) {
-            res.status = 400;
-            res.set_content(create_error("Пустое тело запроса"), "application/json");
-            return;
+        else if (arg == "--max-connections" && i + 1 < argc) {
+            if (!parse_int(argv[++i], server_options.max_connections)) return false;
         }
-
-        try {
-            Task updated_task = Task::from_json(req.body);
-            updated_task.id = task_id;
-
-            if (updated_task.title.empty()) {
-                res.status = 400;
-                res.set_content(create_error("Заголовок задачи обязателен"), "application/json");
-                return;
-            }
-
-            // СИНХРОННО обновляем задачу
-            if (manager.update_task(task_id, updated_task)) {
-                res.set_content(updated_task.to_json(), "application/json");
-                log_operation(log_queue, "PUT /tasks/" + to_string(task_id) + " - Задача обновлена");
-                cout << "  -> Задача #" << task_id << " обновлена" << endl;
-            }
-            else {
-                res.status = 404;
-                res.set_content(create_error("Задача не найдена"), "application/json");
-            }
+        else if (arg == "--request-timeout" && i + 1 < argc) {
+            if (!parse_int(argv[++i], server_options.request_timeout_ms)) return false;
         }
-        catch (const exception& e) {
-            res.status = 400;
-            res.set_content(create_error("Неверный JSON формат"), "application/json");
+        else if (arg == "--compression-threshold" && i + 1 < argc) {
+            if (!parse_int(argv[++i], server_options.compression_threshold)) return false;
         }
-        });
-
-    // ========== PATCH /tasks/{id} - обновить статус (СИНХРОННО) ==========
-    svr.Patch(R"(/tasks/(\d+))", [&manager, &log_queue](const Request& req, Response& res) {
-        int task_id = stoi(req.matches[1]);
-        cout << "PATCH /tasks/" << task_id << "\n";
-
-        if (req.body.empty()) {
-            res.status = 400;
-            res.set_content(create_error("Пустое тело запроса"), "application/json");
-            return;
+        else if (arg == "--event-loops" && i + 1 < argc) {
+            if (!parse_int(argv[++i], server_options.event_loops)) return false;
         }
-
-        try {
-            // Простой парсинг JSON для получения статуса
-            string body = req.body;
-            size_t pos = body.find("\"status\"");
-
-            if (pos == string::npos) {
-                res.status = 400;
-                res.set_content(create_error("Поле 'status' обязательно"), "application/json");
-                return;
-            }
-
-            size_t start = body.find(':', pos);
-            size_t quote1 = body.find('"', start);
-            size_t quote2 = body.find('"', quote1 + 1);
-
-            if (quote1 == string::npos || quote2 == string::npos) {
-                res.status = 400;
-                res.set_content(create_error("Неверный JSON формат"), "application/json");
-                return;
-            }
-
-            string new_status = body.substr(quote1 + 1, quote2 - quote1 - 1);
-
-            // СИНХРОННО обновляем статус
-            if (manager.patch_task(task_id, new_status)) {
-                Task updated_task = manager.get_task_by_id(task_id);
-                res.set_content(updated_task.to_json(), "application/json");
-                log_operation(log_queue, "PATCH /tasks/" + to_string(task_id) +
-                    " - Статус изменен на: " + new_status);
-                cout << "  -> Статус задачи #" << task_id
-                    << " изменен на: " << new_status << endl;
-            }
-            else {
-                res.status = 404;
-                res.set_content(create_error("Задача не найдена"), "application/json");
-            }
+        else if (arg == "--reuse-port") {
+            server_options.reuse_port = true;
         }
-        catch (const exception& e) {
-            res.status = 400;
-            res.set_content(create_error("Неверный JSON формат"), "application/json");
+        else if (arg == "--pin-cpus") {
+            server_options.pin_cpus = true;
         }
-        });
-
-    // ========== DELETE /tasks/{id} - удалить задачу (СИНХРОННО) ==========
-    svr.Delete(R"(/tasks/(\d+))", [&manager, &log_queue](const Request& req, Response& res) {
-        int task_id = stoi(req.matches[1]);
-        cout << "DELETE /tasks/" << task_id << "\n";
-
-        // СИНХРОННО удаляем задачу
-        if (manager.delete_task(task_id)) {
-            res.status = 204;  // No Content
-            log_operation(log_queue, "DELETE /tasks/" + to_string(task_id) + " - Задача удалена");
-            cout << "  -> Задача #" << task_id << " удалена" << endl;
+        else if (arg == "--data" && i + 1 < argc) {
+            options.directory = argv[++i];
+        }
+        else if (arg == "--durability" && i + 1 < argc) {
+            string mode = argv[++i];
+            if (mode == "per-request") options.durability = Durability::PerRequest;
+            else if (mode == "batched") options.durability = Durability::Batched;
+            else if (mode == "async") options.durability = Durability::Async;
+            else return false;
+        }
+        else if (arg == "--log" && i + 1 < argc) {
+            log_options.path = argv[++i];
+        }
+        else if (arg == "--log-level" && i + 1 < argc) {
+            if (!Logger::parse_level(argv[++i], log_options.level)) return false;
         }
         else {
-            res.status = 404;
-            res.set_content(create_error("Задача не найдена"), "application/json");
+            return false;
         }
-        });
+    }
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    setlocale (LC_ALL, "RUS");
+    cout << "=== To-Do API Server ===\n";
+
+    StorageOptions storage_options;
+    LoggerOptions log_options;
+    ServerOptions server_options;
+    bool in_memory = false;
+    if (!parse_args(argc, argv, storage_options, log_options, server_options, in_memory)) {
+        cerr << "Использование: TodoApi [--host <адрес>] [--port N] [--data <каталог>] "
+            "[--durability per-request|batched|async] [--in-memory] "
+            "[--log <файл>] [--log-level debug|info|warn|error] "
+            "[--rate-limit N] [--rate-burst N] [--max-connections N] [--request-timeout <мс>] "
+            "[--compression-threshold <байт>] [--event-loops N] [--reuse-port] [--pin-cpus]" << endl;
+        return 1;
+    }
 
-    // ========== GET / - главная страница ==========
-    svr.Get("/", [](const Request& req, Response& res) {
-        string html = R"(
-<!DOCTYPE html>
-<html>
-<head>
-    <title>To-Do API</title>
-    <style>
-        body { font-family: Arial, sans-serif; margin: 40px; }
-        .endpoint { background: #f5f5f5; padding: 15px; margin: 10px 0; border-radius: 5px; }
-        .method { display: inline-block; padding: 5px 10px; border-radius: 3px; color: white; font-weight: bold; }
-        .get { background: #61affe; }
-        .post { background: #49cc90; }
-        .put { background: #fca130; }
-        .patch { background: #50e3c2; }
-        .delete { background: #f93e3e; }
-    </style>
-</head>
-<body>
-    <h1>📝 To-Do API Server</h1>
-    <p>REST API для управления списком задач с очередью сообщений</p>
-    
-    <div class="endpoint">
-        <span class="method get">GET</span> <strong>/tasks</strong><br>
-        Получить список всех задач
-    </div>
-    
-    <div class="endpoint">
-        <span class="method post">POST</span> <strong>/tasks</strong><br>
-        Создать новую задачу<br>
-        Пример: {"title": "Задача", "description": "Описание", "status": "todo"}
-    </div>
-    
-    <div class="endpoint">
-        <span class="method get">GET</span> <strong>/tasks/{id}</strong><br>
-        Получить задачу по ID
-    </div>
-    
-    <div class="endpoint">
-        <span class="method put">PUT</span> <strong>/tasks/{id}</strong><br>
-        Полностью обновить задачу
-    </div>
-    
-    <div class="endpoint">
-        <span class="method patch">PATCH</span> <strong>/tasks/{id}</strong><br>
-        Обновить статус задачи<br>
-        Пример: {"status": "in_progress"}
-    </div>
-    
-    <div class="endpoint">
-        <span class="method delete">DELETE</span> <strong>/tasks/{id}</strong><br>
-        Удалить задачу по ID
-    </div>
-    
-    <p><strong>Особенность:</strong> Все операции логируются через очередь сообщений</p>
-</body>
-</html>
-        )";
+    // Асинхронный лог операций
+    Logger logger;
+    if (!logger.start(log_options)) {
+        cerr << "Не удалось открыть лог " << log_options.path << endl;
+        return 1;
+    }
 
-        res.set_content(html, "text/html");
-        });
+    // Очередь фоновых задач, выполняемых вне пути запроса
+    MessageQueue job_queue(8192, OverflowPolicy::Block);
+    job_queue.start();
 
-    cout << "Сервер запущен на http://localhost:8080" << endl;
-    cout << "Документация: http://localhost:8080/" << endl;
+    // Создаем менеджер задач (передаем ему очередь для демонстрации)
+    TaskManager manager(job_queue);
+
+    // Восстанавливаем задачи из снимка и журнала
+    if (!in_memory) {
+        if (!manager.open_storage(storage_options)) {
+            cerr << "Не удалось открыть хранилище " << storage_options.directory << endl;
+            job_queue.stop();
+            return 1;
+        }
+        cout << "Хранилище: " << storage_options.directory
+            << ", восстановлено задач: " << manager.size() << endl;
+    }
+
+    Server svr;
+    svr.set_rate_limit(server_options.rate_limit,
+        server_options.rate_burst > 0 ? server_options.rate_burst : server_options.rate_limit);
+    svr.set_max_connections(server_options.max_connections);
+    svr.set_request_timeout(chrono::milliseconds(server_options.request_timeout_ms));
+    svr.set_compression_threshold(server_options.compression_threshold);
+    svr.set_event_loop_count(server_options.event_loops);
+    svr.set_reuse_port(server_options.reuse_port);
+    svr.set_cpu_affinity(server_options.pin_cpus);
+
+    register_routes(svr, manager, logger, job_queue);
+
+    string base_url = "http://" + server_options.host + ":" + to_string(server_options.port);
+    cout << "Сервер запущен на " << base_url << endl;
+    cout << "Документация: " << base_url << "/" << endl;
     cout << "\nДоступные эндпоинты:" << endl;
-    cout << "  GET    /tasks           - Все задачи" << endl;
+    cout << "  GET    /tasks           - Все задачи (?status=, ?limit=&cursor=)" << endl;
+    cout << "  GET    /tasks/stats     - Число задач по статусам" << endl;
+    cout << "  GET    /tasks/changes   - Лента изменений (?since=, SSE или long-poll)" << endl;
+    cout << "  GET    /metrics         - Метрики Prometheus" << endl;
     cout << "  POST   /tasks           - Создать задачу" << endl;
+    cout << "  POST   /tasks:batch     - Создать несколько задач" << endl;
+    cout << "  PATCH  /tasks:batch     - Изменить несколько задач" << endl;
     cout << "  GET    /tasks/{id}      - Задача по ID" << endl;
     cout << "  PUT    /tasks/{id}      - Обновить задачу" << endl;
     cout << "  PATCH  /tasks/{id}      - Обновить статус" << endl;
@@ -289,13 +164,13 @@ int main() {
     cout << "\nНажмите Ctrl+C для остановки сервера\n" << endl;
 
     // Запуск сервера
-    svr.listen("localhost", 8080);
+    svr.listen(server_options.host, server_options.port);
 
-    // Останавливаем очередь логов
-    log_queue.stop();
-    if (log_worker.joinable()) {
-        log_worker.join();
+    // Дорабатываем фоновые задачи и дописываем лог
+    if (!job_queue.stop(true)) {
+        cerr << "Фоновые задачи не завершились вовремя, отброшено: " << job_queue.dropped() << endl;
     }
+    logger.stop();
 
     return 0;
 }
\ No newline at end of file
@@ -1,4 +1,239 @@
 #include "queue.h"
 
-//    ,       
-// (     )
\ No newline at end of file
+namespace {
+    // Очередь, чей обработчик выполняется в текущем потоке
+    thread_local const MessageQueue* current_queue = nullptr;
+}
+
+MessageQueue::Worker::Worker(size_t capacity) {
+    for (auto& ring : keyed) ring.reset(new HandlerRing(capacity));
+}
+
+MessageQueue::MessageQueue(size_t capacity, OverflowPolicy policy, size_t worker_count) : policy(policy) {
+    for (auto& ring : shared) ring.reset(new HandlerRing(capacity));
+    if (worker_count == 0) worker_count = 1;
+    for (size_t i = 0; i < worker_count; i++) {
+        workers.emplace_back(new Worker(capacity));
+    }
+}
+
+MessageQueue::~MessageQueue() {
+    stop(true);
+}
+
+// Засыпает, пока не выполнится ready или очередь не остановят. Счетчик
+// ожидающих увеличивается до повторной проверки условия, а будящая сторона
+// читает его после своей операции с очередью, поэтому пробуждение не теряется
+template <typename Ready>
+void MessageQueue::park(std::atomic<int>& waiting, std::condition_variable& cv, Ready ready) {
+    std::unique_lock<std::mutex> lock(park_mtx);
+    waiting.fetch_add(1, std::memory_order_seq_cst);
+    while (!ready() && !stopped.load(std::memory_order_acquire)) {
+        cv.wait(lock);
+    }
+    waiting.fetch_sub(1, std::memory_order_relaxed);
+}
+
+void MessageQueue::wake(std::atomic<int>& waiting, std::condition_variable& cv) {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (waiting.load(std::memory_order_relaxed) == 0) return;
+    std::lock_guard<std::mutex> lock(park_mtx);
+    cv.notify_all();
+}
+
+void MessageQueue::start() {
+    std::lock_guard<std::mutex> lock(lifecycle_mtx);
+    if (started || stopped) return;
+    started = true;
+    for (auto& worker : workers) {
+        Worker* w = worker.get();
+        w->thread = std::thread([this, w]() { worker_loop(*w); });
+    }
+}
+
+bool MessageQueue::push(TaskHandler handler, MessagePriority priority) {
+    return push_to(*shared[(int)priority], handler);
+}
+
+bool MessageQueue::push_keyed(uint64_t key, TaskHandler handler, MessagePriority priority) {
+    Worker& worker = *workers[key % workers.size()];
+    return push_to(*worker.keyed[(int)priority], handler);
+}
+
+bool MessageQueue::push_to(HandlerRing& ring, TaskHandler& handler) {
+    for (;;) {
+        if (!accepting.load(std::memory_order_acquire)) return false;
+
+        // Счетчик растет до вставки, иначе обработчик мог бы уменьшить его раньше
+        outstanding.fetch_add(1, std::memory_order_acq_rel);
+        if (ring.try_push(handler)) {
+            wake(consumers_waiting, consumers_cv);
+            return true;
+        }
+        finish(1);
+
+        switch (policy) {
+        case OverflowPolicy::Drop:
+            dropped_count.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        case OverflowPolicy::DropOldest: {
+            TaskHandler oldest;
+            if (ring.try_pop(oldest)) {
+                dropped_count.fetch_add(1, std::memory_order_relaxed);
+                finish(1);
+            }
+            break;
+        }
+        case OverflowPolicy::Block:
+            park(producers_waiting, producers_cv, [this, &ring] {
+                return !ring.full() || !accepting.load(std::memory_order_acquire);
+                });
+            break;
+        }
+    }
+}
+
+// Сначала свои сообщения с ключом, затем общие - по убыванию приоритета
+bool MessageQueue::pop_for(Worker& worker, TaskHandler& handler) {
+    for (int p = 0; p < priority_count; p++) {
+        if (worker.keyed[p]->try_pop(handler)) return true;
+        if (shared[p]->try_pop(handler)) return true;
+    }
+    return false;
+}
+
+bool MessageQueue::has_work(Worker& worker) const {
+    for (int p = 0; p < priority_count; p++) {
+        if (!worker.keyed[p]->empty() || !shared[p]->empty()) return true;
+    }
+    return false;
+}
+
+void MessageQueue::worker_loop(Worker& worker) {
+    current_queue = this;
+    TaskHandler handler;
+    while (!stopped.load(std::memory_order_acquire)) {
+        if (pop_for(worker, handler)) {
+            wake(producers_waiting, producers_cv);
+            // Исключение из одного сообщения не должно останавливать обработчик
+            try {
+                handler();
+            }
+            catch (...) {
+            }
+            handler = nullptr;
+            finish(1);
+            continue;
+        }
+
+        // Короткое ожидание без сна: при плотном потоке сообщений
+        // следующее обычно приходит раньше, чем поток успел бы уснуть
+        bool ready = false;
+        for (int spin = 0; spin < 64 && !ready; spin++) {
+            std::this_thread::yield();
+            ready = has_work(worker) || stopped.load(std::memory_order_acquire);
+        }
+        if (!ready) {
+            park(consumers_waiting, consumers_cv, [this, &worker] { return has_work(worker); });
+        }
+    }
+}
+
+void MessageQueue::finish(size_t count) {
+    if (outstanding.fetch_sub(count, std::memory_order_acq_rel) == count) {
+        wake(drain_waiting, drain_cv);
+    }
+}
+
+size_t MessageQueue::discard_all() {
+    TaskHandler handler;
+    size_t count = 0;
+    for (auto& worker : workers) {
+        while (pop_for(*worker, handler)) {
+            handler = nullptr;
+            count++;
+        }
+    }
+    if (count > 0) {
+        dropped_count.fetch_add(count, std::memory_order_relaxed);
+        finish(count);
+    }
+    return count;
+}
+
+bool MessageQueue::drain(std::chrono::milliseconds timeout) {
+    auto deadline = std::chrono::steady_clock::now() + timeout;
+    std::unique_lock<std::mutex> lock(park_mtx);
+    drain_waiting.fetch_add(1, std::memory_order_seq_cst);
+    bool done = drain_cv.wait_until(lock, deadline, [this] {
+        return outstanding.load(std::memory_order_acquire) == 0;
+        });
+    drain_waiting.fetch_sub(1, std::memory_order_relaxed);
+    return done;
+}
+
+// Новые сообщения больше не принимаются, ждущие места производители отпускаются
+void MessageQueue::halt() {
+    accepting.store(false, std::memory_order_release);
+    std::lock_guard<std::mutex> lock(park_mtx);
+    producers_cv.notify_all();
+}
+
+bool MessageQueue::stop(bool flush, std::chrono::milliseconds flush_timeout) {
+    // Из обработчика нельзя ни дождаться очереди (он сам в ней числится),
+    // ни присоединить собственный поток, ни ждать lifecycle_mtx: его может
+    // держать stop из другого потока, который присоединяет этот обработчик
+    if (current_queue == this) {
+        halt();
+        stopped.store(true, std::memory_order_release);
+        discard_all();
+        std::lock_guard<std::mutex> lock(park_mtx);
+        consumers_cv.notify_all();
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lifecycle(lifecycle_mtx);
+    bool completed = true;
+    if (!stopped.load(std::memory_order_acquire)) {
+        completed = shutdown(flush, flush_timeout);
+    }
+    for (auto& worker : workers) {
+        if (worker->thread.joinable()) worker->thread.join();
+    }
+    if (discard_all() > 0) completed = false;
+    return completed;
+}
+
+bool MessageQueue::shutdown(bool flush, std::chrono::milliseconds flush_timeout) {
+    halt();
+
+    bool completed = true;
+    if (flush) {
+        if (started) {
+            // Обработчик, который завис, не должен держать остановку вечно:
+            // после таймаута очередь отбрасывается, а потоки дожидаются как при stop(false)
+            completed = drain(flush_timeout);
+            if (!completed) discard_all();
+        }
+        else {
+            // Обработчики не запускались - дорабатываем очередь в текущем потоке
+            TaskHandler handler;
+            for (auto& worker : workers) {
+                while (pop_for(*worker, handler)) {
+                    try {
+                        handler();
+                    }
+                    catch (...) {
+                    }
+                    handler = nullptr;
+                    finish(1);
+                }
+            }
+        }
+    }
+
+    stopped.store(true, std::memory_order_release);
+    std::lock_guard<std::mutex> lock(park_mtx);
+    consumers_cv.notify_all();
+    return completed;
+}
\ No newline at end of file
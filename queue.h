@@ -1,46 +1,200 @@
 #pragma once
 #include <functional>
-#include <queue>
+#include <vector>
+#include <memory>
 #include <mutex>
 #include <condition_variable>
 #include <thread>
 #include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
 
-class MessageQueue {
+// Что делать с новым сообщением, если очередь заполнена
+enum class OverflowPolicy {
+    Block,       // ждать, пока потребитель освободит место
+    Drop,        // отбросить новое сообщение
+    DropOldest   // вытеснить самое старое сообщение
+};
+
+// Сообщения с более высоким приоритетом выбираются обработчиками раньше
+enum class MessagePriority { High, Normal, Low };
+
+// Ограниченная lock-free очередь с несколькими производителями и потребителями
+// (кольцевой буфер Вьюкова). У каждой ячейки свой счетчик sequence: по нему
+// производитель и потребитель понимают, свободна ли ячейка, и занимают позицию
+// одним CAS без общих блокировок
+class HandlerRing {
 public:
     using TaskHandler = std::function<void()>;
 
-    void push(TaskHandler handler) {
-        std::lock_guard<std::mutex> lock(mtx);
-        queue.push(handler);
-        cv.notify_one();
+    explicit HandlerRing(size_t capacity) {
+        size_t size = 2;
+        while (size < capacity) size <<= 1;
+        mask = size - 1;
+        slots.reset(new Slot[size]);
+        for (size_t i = 0; i < size; i++) {
+            slots[i].sequence.store(i, std::memory_order_relaxed);
+        }
     }
 
-    void run() {
-        while (!stopped) {
-            TaskHandler handler;
-            {
-                std::unique_lock<std::mutex> lock(mtx);
-                cv.wait(lock, [this] { return !queue.empty() || stopped; });
-
-                if (stopped && queue.empty()) break;
-                if (!queue.empty()) {
-                    handler = queue.front();
-                    queue.pop();
+    HandlerRing(const HandlerRing&) = delete;
+    HandlerRing& operator=(const HandlerRing&) = delete;
+
+    // Перемещает handler в очередь; false - очередь полна, handler не тронут
+    bool try_push(TaskHandler& handler) {
+        size_t pos = enqueue_pos.load(std::memory_order_relaxed);
+        for (;;) {
+            Slot& slot = slots[pos & mask];
+            size_t seq = slot.sequence.load(std::memory_order_acquire);
+            intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+            if (diff == 0) {
+                if (enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    slot.handler = std::move(handler);
+                    slot.sequence.store(pos + 1, std::memory_order_release);
+                    return true;
                 }
             }
-            if (handler) handler();
+            else if (diff < 0) {
+                return false;  // ячейку еще не освободил потребитель - очередь полна
+            }
+            else {
+                pos = enqueue_pos.load(std::memory_order_relaxed);
+            }
         }
     }
 
-    void stop() {
-        stopped = true;
-        cv.notify_all();
+    bool try_pop(TaskHandler& handler) {
+        size_t pos = dequeue_pos.load(std::memory_order_relaxed);
+        for (;;) {
+            Slot& slot = slots[pos & mask];
+            size_t seq = slot.sequence.load(std::memory_order_acquire);
+            intptr_t diff = (intptr_t)seq - (intptr_t)(pos + 1);
+            if (diff == 0) {
+                if (dequeue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    handler = std::move(slot.handler);
+                    slot.handler = nullptr;
+                    slot.sequence.store(pos + mask + 1, std::memory_order_release);
+                    return true;
+                }
+            }
+            else if (diff < 0) {
+                return false;  // ячейку еще не заполнил производитель - очередь пуста
+            }
+            else {
+                pos = dequeue_pos.load(std::memory_order_relaxed);
+            }
+        }
     }
 
+    bool empty() const {
+        size_t pos = dequeue_pos.load(std::memory_order_acquire);
+        return slots[pos & mask].sequence.load(std::memory_order_acquire) != pos + 1;
+    }
+
+    bool full() const {
+        size_t pos = enqueue_pos.load(std::memory_order_acquire);
+        return slots[pos & mask].sequence.load(std::memory_order_acquire) != pos;
+    }
+
+    size_t capacity() const { return mask + 1; }
+
+private:
+    struct alignas(64) Slot {
+        std::atomic<size_t> sequence{ 0 };
+        TaskHandler handler;
+    };
+
+    std::unique_ptr<Slot[]> slots;
+    size_t mask = 0;
+
+    // Позиции производителей и потребителей в разных кэш-линиях
+    alignas(64) std::atomic<size_t> enqueue_pos{ 0 };
+    alignas(64) std::atomic<size_t> dequeue_pos{ 0 };
+};
+
+// Пул фоновых обработчиков поверх HandlerRing. На каждый приоритет своя общая
+// очередь, которую разбирают все обработчики. Сообщения с ключом (push_keyed)
+// попадают в очередь конкретного обработчика по ключу, поэтому сообщения с одним
+// ключом и приоритетом выполняются строго по порядку.
+// Мьютекс нужен только для парковки: обработчик засыпает, когда очереди пусты,
+// производитель - когда очередь полна при Block. Пока никто не спит, push его не трогает.
+class MessageQueue {
+public:
+    using TaskHandler = HandlerRing::TaskHandler;
+
+    static const int priority_count = 3;
+
+    explicit MessageQueue(size_t capacity = 4096, OverflowPolicy policy = OverflowPolicy::Block,
+        size_t workers = 1);
+    ~MessageQueue();
+
+    MessageQueue(const MessageQueue&) = delete;
+    MessageQueue& operator=(const MessageQueue&) = delete;
+
+    // Запускает обработчики
+    void start();
+
+    // Обработчик перемещается в очередь. false - сообщение не принято
+    // (очередь полна при Drop или остановлена)
+    bool push(TaskHandler handler, MessagePriority priority = MessagePriority::Normal);
+    // То же, но сообщения с одинаковым key выполняются в порядке добавления
+    bool push_keyed(uint64_t key, TaskHandler handler, MessagePriority priority = MessagePriority::Normal);
+
+    // Ждет, пока все принятые сообщения будут выполнены. false - не успели за timeout
+    bool drain(std::chrono::milliseconds timeout);
+
+    // Перестает принимать сообщения и останавливает обработчики. При flush
+    // сначала выполняется все, что уже в очереди, но не дольше flush_timeout:
+    // дальше оставшееся отбрасывается и обработчики дожидаются. false - что-то
+    // из принятого так и не выполнилось. Из обработчика этой же очереди только
+    // запрещает прием и будит остальных, а дожидается потоков следующий вызов
+    // из другого потока или деструктор
+    bool stop(bool flush = true,
+        std::chrono::milliseconds flush_timeout = std::chrono::milliseconds(5000));
+
+    // Сколько сообщений отброшено из-за переполнения или stop(false)
+    uint64_t dropped() const { return dropped_count.load(std::memory_order_relaxed); }
+    // Сколько принятых сообщений еще не выполнено
+    size_t pending() const { return outstanding.load(std::memory_order_acquire); }
+
 private:
-    std::queue<TaskHandler> queue;
-    std::mutex mtx;
-    std::condition_variable cv;
+    struct Worker {
+        explicit Worker(size_t capacity);
+
+        std::unique_ptr<HandlerRing> keyed[priority_count];
+        std::thread thread;
+    };
+
+    bool push_to(HandlerRing& ring, TaskHandler& handler);
+    bool pop_for(Worker& worker, TaskHandler& handler);
+    bool has_work(Worker& worker) const;
+    void worker_loop(Worker& worker);
+    void finish(size_t count);
+    size_t discard_all();
+    void halt();
+    bool shutdown(bool flush, std::chrono::milliseconds flush_timeout);
+
+    template <typename Ready>
+    void park(std::atomic<int>& waiting, std::condition_variable& cv, Ready ready);
+    void wake(std::atomic<int>& waiting, std::condition_variable& cv);
+
+    OverflowPolicy policy;
+    std::unique_ptr<HandlerRing> shared[priority_count];
+    std::vector<std::unique_ptr<Worker>> workers;
+    bool started = false;
+
+    alignas(64) std::atomic<bool> accepting{ true };
     std::atomic<bool> stopped{ false };
+    std::atomic<size_t> outstanding{ 0 };
+    std::atomic<uint64_t> dropped_count{ 0 };
+
+    std::atomic<int> consumers_waiting{ 0 };
+    std::atomic<int> producers_waiting{ 0 };
+    std::atomic<int> drain_waiting{ 0 };
+    std::mutex park_mtx;
+    std::condition_variable consumers_cv;
+    std::condition_variable producers_cv;
+    std::condition_variable drain_cv;
+    std::mutex lifecycle_mtx;  // start/stop
 };
\ No newline at end of file
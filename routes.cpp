@@ -0,0 +1,893 @@
+﻿#include "routes.h"
+#include "json_codec.h"
+#include <chrono>
+#include <random>
+#include <limits>
+
+using namespace httplib;
+using namespace std;
+
+namespace {
+
+    // Запись об операции в асинхронный лог: поток запроса только копирует
+    // строку в свой буфер и никогда не ждет вывода
+    void log_operation(Logger& logger, string_view operation, int task_id = 0) {
+        logger.write(LogLevel::Info, operation, task_id);
+    }
+
+    // Идентификатор задачи из пути /tasks/{id} (0, если не помещается в int)
+    int task_id_param(const Request& req) {
+        int id = 0;
+        if (!parse_int(req.get_path_param("id"), id)) return 0;
+        return id;
+    }
+
+    // Максимальный размер страницы GET /tasks?limit=
+    const int MAX_PAGE_SIZE = 1000;
+    // Сколько задач отдается за одну порцию потокового списка
+    const int STREAM_BATCH_SIZE = 256;
+    // Полный список до этого размера собирается одной строкой и кэшируется
+    // до следующего изменения; больше - отдается потоком
+    const size_t LIST_CACHE_MAX_TASKS = 10000;
+
+    // JSON всего списка задач для версии коллекции. Повторные GET /tasks без
+    // изменений между ними отдают эту строку без обхода снимка, а сервер сжимает
+    // ее один раз для всех клиентов
+    struct ListCache {
+        uint64_t version = 0;
+        string json;
+    };
+
+    // ETag для номера версии. Версии начинаются заново при каждом запуске,
+    // поэтому в метку входит случайный идентификатор процесса.
+    // Метка собирается на стеке и копируется сразу в заголовок ответа
+    struct Etag {
+        char data[32];
+        size_t size = 0;
+
+        string_view view() const { return string_view(data, size); }
+    };
+
+    Etag make_etag(uint64_t version) {
+        static const string prefix = []() {
+            random_device rd;
+            char buffer[16];
+            snprintf(buffer, sizeof(buffer), "%08x", (unsigned)rd());
+            return string(buffer);
+        }();
+        Etag etag;
+        char* out = etag.data;
+        *out++ = '"';
+        out = copy(prefix.begin(), prefix.end(), out);
+        *out++ = '-';
+        out = to_chars(out, etag.data + sizeof(etag.data) - 1, version).ptr;
+        *out++ = '"';
+        etag.size = out - etag.data;
+        return etag;
+    }
+
+    // Совпадает ли etag с одним из значений If-None-Match (список через запятую, W/ или *)
+    bool etag_matches(const Request& req, string_view etag) {
+        string_view header = req.get_header_value("If-None-Match");
+        while (!header.empty()) {
+            size_t comma = header.find(',');
+            string_view item = header.substr(0, comma);
+            header = comma == string_view::npos ? string_view() : header.substr(comma + 1);
+
+            while (!item.empty() && item.front() == ' ') item.remove_prefix(1);
+            while (!item.empty() && item.back() == ' ') item.remove_suffix(1);
+            if (item.substr(0, 2) == "W/") item.remove_prefix(2);
+            if (item == "*" || item == etag) return true;
+        }
+        return false;
+    }
+
+    // Ответ 304: у клиента актуальная версия, тело не нужно
+    void not_modified(Response& res, string_view etag) {
+        res.status = 304;
+        res.set_header("ETag", etag);
+    }
+
+    // Наибольшее число элементов в одном пакетном запросе
+    const size_t MAX_BATCH_SIZE = 10000;
+
+    // Результаты элементов пакета: {"status":201,"task":{...}} или {"status":400,"error":"..."}
+    void append_item_task(pmr::string& out, int status, const TaskRecord& task) {
+        out += "{\"status\":";
+        json_append_int(out, status);
+        out += ",\"task\":";
+        out += task.json();
+        out += "}";
+    }
+
+    void append_item_error(pmr::string& out, int status, string_view message) {
+        out += "{\"status\":";
+        json_append_int(out, status);
+        out += ",\"error\":";
+        json_append_string(out, message);
+        out += "}";
+    }
+
+    // Элемент пакетного PATCH: {"id":N, "title"?, "description"?, "status"?}.
+    // false - некорректный JSON; ошибка самого элемента возвращается в error
+    bool read_task_change(JsonReader& reader, TaskChange& change, string& error) {
+        string_view key;
+        string value;
+        long long id = 0;
+        bool has_id = false;
+
+        if (!reader.begin_object()) return false;
+        while (reader.next_key(key)) {
+            if (key == "id") {
+                if (!reader.read_int(id)) return false;
+                has_id = true;
+            }
+            else if (key == "title" || key == "description") {
+                if (!reader.read_string(value)) return false;
+                if (key == "title") change.title = value;
+                else change.description = value;
+            }
+            else if (key == "status") {
+                if (!reader.read_string(value)) return false;
+                TaskStatus status;
+                if (Task::parse_status(value, status)) change.status = status;
+                else error = "Неизвестный статус";
+            }
+            else if (!reader.skip_value()) {
+                return false;
+            }
+        }
+        if (!reader.ok()) return false;
+
+        if (!has_id || id <= 0 || id > numeric_limits<int>::max()) error = "Поле 'id' обязательно";
+        else if (change.title && change.title->empty()) error = "Заголовок задачи обязателен";
+        change.id = (int)id;
+        return true;
+    }
+
+    // Тело ошибки {"error":"..."} собирается прямо в памяти ответа
+    void set_error(Response& res, string_view message) {
+        pmr::string& body = res.begin_content("application/json");
+        body += "{\"error\":";
+        json_append_string(body, message);
+        body += "}";
+    }
+
+    // Изменение видно в памяти, но журнал его не сохранил
+    void set_storage_error(Response& res) {
+        res.status = 500;
+        set_error(res, "Не удалось сохранить изменения");
+    }
+
+    // Тело POST/PUT /tasks. false - ответ 400 уже заполнен
+    bool read_task_body(const Request& req, Response& res, Task& task) {
+        JsonReader reader(req.body);
+        string error;
+        if (!Task::read_json(reader, task, error) || !reader.finish()) error = "Неверный JSON формат";
+        else if (error.empty() && task.title.empty()) error = "Заголовок задачи обязателен";
+        if (error.empty()) return true;
+        res.status = 400;
+        set_error(res, error);
+        return false;
+    }
+
+    // Сколько событий ленты отдается за один ответ long-poll или одну порцию SSE
+    const size_t CHANGE_BATCH_SIZE = 256;
+    // Long-poll: ожидание по умолчанию и наибольшее (?timeout=, секунды)
+    const int CHANGE_POLL_TIMEOUT = 30;
+    const int MAX_CHANGE_POLL_TIMEOUT = 300;
+    // SSE: комментарий-пинг, если событий не было столько времени
+    const chrono::seconds SSE_HEARTBEAT(15);
+
+    // Ответ long-poll: {"next":<номер для следующего since>,"events":[...]}
+    template <typename String>
+    void append_changes_json(String& out, const vector<ChangeEvent>& events, uint64_t next) {
+        out += "{\"next\":";
+        json_append_int(out, (long long)next);
+        out += ",\"events\":[";
+        for (size_t i = 0; i < events.size(); i++) {
+            if (i > 0) out += ",";
+            events[i].append_json(out);
+        }
+        out += "]}";
+    }
+
+    // Подписка одного клиента ленты. Пока клиент ждет, она не держит поток:
+    // ChangeFeed будит соединение через DataSink::wake, а провайдер дочитывает кольцо
+    struct ChangeStream {
+        ChangeFeed& feed;
+        uint64_t since;
+        bool sse;
+        // Long-poll - когда отдать пустой ответ, SSE - когда отправить пинг
+        chrono::steady_clock::time_point deadline;
+        uint64_t subscription = 0;
+        vector<ChangeEvent> events;
+        string chunk;
+
+        ChangeStream(ChangeFeed& feed, uint64_t since, bool sse, chrono::steady_clock::time_point deadline)
+            : feed(feed), since(since), sse(sse), deadline(deadline) {}
+        ChangeStream(const ChangeStream&) = delete;
+        ChangeStream& operator=(const ChangeStream&) = delete;
+        ~ChangeStream() {
+            if (subscription) feed.unsubscribe(subscription);
+        }
+
+        bool provide(DataSink& sink) {
+            // Подписка до чтения: событие, записанное между ними, разбудит еще раз
+            if (!subscription) subscription = feed.subscribe(sink.wake);
+            auto now = chrono::steady_clock::now();
+            events.clear();
+            chunk.clear();
+
+            if (feed.read(since, CHANGE_BATCH_SIZE, events) != ChangeFeed::ReadResult::Ok) {
+                // Клиент отстал больше, чем на размер истории: он должен перечитать список
+                uint64_t last = feed.last_seq();
+                if (sse) {
+                    chunk += "event: reset\ndata: {\"seq\":";
+                    json_append_int(chunk, (long long)last);
+                    chunk += "}\n\n";
+                }
+                else {
+                    chunk += "{\"next\":";
+                    json_append_int(chunk, (long long)last);
+                    chunk += ",\"events\":[],\"reset\":true}";
+                }
+                sink.write(chunk.data(), chunk.size());
+                sink.done();
+                return true;
+            }
+
+            if (!sse) {
+                if (events.empty() && now < deadline) return true;
+                if (!events.empty()) since = events.back().seq;
+                append_changes_json(chunk, events, since);
+                sink.write(chunk.data(), chunk.size());
+                sink.done();
+                return true;
+            }
+
+            for (const ChangeEvent& event : events) {
+                chunk += "id: ";
+                json_append_int(chunk, (long long)event.seq);
+                chunk += "\nevent: ";
+                chunk += ChangeEvent::type_name(event.type);
+                chunk += "\ndata: ";
+                event.append_json(chunk);
+                chunk += "\n\n";
+            }
+            if (!events.empty()) {
+                since = events.back().seq;
+                deadline = now + SSE_HEARTBEAT;
+            }
+            else if (now >= deadline) {
+                chunk += ": ping\n\n";
+                deadline = now + SSE_HEARTBEAT;
+            }
+            if (!chunk.empty()) sink.write(chunk.data(), chunk.size());
+            return true;
+        }
+    };
+
+} // namespace
+
+void register_routes(Server& svr, TaskManager& manager, Logger& logger, MessageQueue& job_queue) {
+    // ========== GET /tasks - все задачи ==========
+    // ?status=todo|in_progress|done - фильтр по статусу
+    // ?limit=N&cursor=<id> - страница из N задач с id больше cursor,
+    //   курсор следующей страницы приходит в заголовке X-Next-Cursor
+    // Без limit список отдается потоком (chunked) прямо из снимка, не собираясь в памяти
+    // ETag - версия всей коллекции; при совпадении с If-None-Match отвечаем 304,
+    // не собирая снимок
+    // Живет, пока живы обработчики
+    auto list_cache = make_shared<shared_ptr<const ListCache>>();
+    svr.Get("/tasks", [&manager, &logger, list_cache](const Request& req, Response& res) {
+        log_operation(logger, "GET /tasks - Получение всех задач");
+
+        bool by_status = req.has_param("status");
+        TaskStatus status = TaskStatus::TODO;
+        if (by_status && !Task::parse_status(req.get_param_value("status"), status)) {
+            res.status = 400;
+            set_error(res, "Неизвестный статус");
+            return;
+        }
+
+        int cursor = 0;
+        if (req.has_param("cursor") && !parse_int(req.get_param_value("cursor"), cursor)) {
+            res.status = 400;
+            set_error(res, "Неверный cursor");
+            return;
+        }
+
+        // Номер ленты изменений тоже читается до снимка: продолжая с него, клиент
+        // может получить изменения, уже вошедшие в снимок, но не пропустит ни одного
+        uint64_t change_seq = manager.changes().last_seq();
+        // Версия читается до снимка, поэтому снимок не старше своего ETag
+        uint64_t version = manager.collection_version();
+        Etag etag = make_etag(version);
+        if (etag_matches(req, etag.view())) {
+            not_modified(res, etag.view());
+            return;
+        }
+        res.set_header("ETag", etag.view());
+        res.set_header("X-Change-Seq", to_string(change_seq));
+
+        bool full_list = !by_status && cursor == 0 && !req.has_param("limit");
+        if (full_list) {
+            shared_ptr<const ListCache> cached = atomic_load(list_cache.get());
+            if (cached && cached->version == version) {
+                res.set_content(cached, cached->json, "application/json");
+                return;
+            }
+        }
+
+        // Фильтр по статусу идет через индекс, просматриваются только подходящие задачи
+        auto tasks = by_status ? manager.get_tasks_by_status(status) : manager.get_all_tasks();
+
+        if (full_list && tasks.size() <= LIST_CACHE_MAX_TASKS) {
+            auto fresh = make_shared<ListCache>();
+            fresh->version = version;
+            fresh->json += "[";
+            tasks.for_each([&fresh](const TaskRecord& task) {
+                if (fresh->json.size() > 1) fresh->json += ",";
+                fresh->json += task.json();
+                return true;
+                });
+            fresh->json += "]";
+            // Снимок может быть новее version - тогда следующая версия просто соберет список заново
+            atomic_store(list_cache.get(), shared_ptr<const ListCache>(fresh));
+            res.set_content(fresh, fresh->json, "application/json");
+            return;
+        }
+
+        if (req.has_param("limit")) {
+            int limit = 0;
+            if (!parse_int(req.get_param_value("limit"), limit) || limit == 0) {
+                res.status = 400;
+                set_error(res, "Неверный limit");
+                return;
+            }
+            limit = min(limit, MAX_PAGE_SIZE);
+
+            pmr::string& result = res.begin_content("application/json");
+            result += "[";
+            int count = 0;
+            int last_id = 0;
+            bool more = false;
+            tasks.for_each([&](const TaskRecord& task) {
+                if (count == limit) {
+                    more = true;
+                    return false;
+                }
+                if (count > 0) result += ",";
+                result += task.json();
+                last_id = task.id;
+                count++;
+                return true;
+                }, cursor);
+            result += "]";
+
+            if (more) res.set_header("X-Next-Cursor", to_string(last_id));
+            return;
+        }
+
+        // Каждый вызов отдает следующую порцию задач, продолжая после last_id
+        struct ListState {
+            TaskSnapshot tasks;
+            int last_id;
+            bool first;
+        };
+        auto state = make_shared<ListState>(ListState{ move(tasks), cursor, true });
+        res.set_chunked_content_provider("application/json", [state](size_t offset, DataSink& sink) {
+            string chunk = offset == 0 ? "[" : "";
+            int emitted = 0;
+            bool finished = true;
+            state->tasks.for_each([&](const TaskRecord& task) {
+                if (emitted == STREAM_BATCH_SIZE) {
+                    finished = false;
+                    return false;
+                }
+                state->last_id = task.id;
+                if (!state->first) chunk += ",";
+                state->first = false;
+                chunk += task.json();
+                emitted++;
+                return true;
+                }, state->last_id);
+
+            if (finished) chunk += "]";
+            sink.write(chunk.data(), chunk.size());
+            if (finished) sink.done();
+            return true;
+            });
+        });
+
+    // ========== GET /tasks/stats - число задач по статусам ==========
+    // Счетчики ведутся при каждом изменении, запрос не обходит задачи
+    svr.Get("/tasks/stats", [&manager](const Request&, Response& res) {
+        pmr::string& result = res.begin_content("application/json");
+        result += "{\"total\":";
+        json_append_int(result, manager.size());
+        for (TaskStatus status : { TaskStatus::TODO, TaskStatus::IN_PROGRESS, TaskStatus::DONE }) {
+            result += ",\"";
+            result += Task::status_to_string(status);
+            result += "\":";
+            json_append_int(result, manager.count_by_status(status));
+        }
+        result += "}";
+        });
+
+    // ========== GET /tasks/changes - лента изменений задач ==========
+    // ?since=<seq> - события с номером больше seq; без него - только новые.
+    //   Начальный номер - заголовок X-Change-Seq ответа GET /tasks
+    // С Accept: text/event-stream - поток Server-Sent Events (id - номер события,
+    //   при переподключении продолжает с Last-Event-ID), иначе long-poll: ответ
+    //   приходит, как только появятся события, или через ?timeout= секунд
+    // 410 - события после since уже вытеснены из истории, нужно перечитать GET /tasks
+    svr.Get("/tasks/changes", [&manager](const Request& req, Response& res) {
+        ChangeFeed& feed = manager.changes();
+        bool sse = req.get_header_value("Accept").find("text/event-stream") != string_view::npos;
+        // HTTP/1.0 не поддерживает chunked: только немедленный ответ
+        bool can_wait = req.version == "HTTP/1.1";
+
+        uint64_t since = feed.last_seq();
+        string_view since_text;
+        if (req.has_param("since")) since_text = req.get_param_value("since");
+        else if (sse && req.has_header("Last-Event-ID")) since_text = req.get_header_value("Last-Event-ID");
+        if (!since_text.empty() || req.has_param("since")) {
+            if (!parse_int(since_text, since)) {
+                res.status = 400;
+                set_error(res, "Неверный since");
+                return;
+            }
+        }
+
+        int timeout = CHANGE_POLL_TIMEOUT;
+        if (req.has_param("timeout") && !parse_int(req.get_param_value("timeout"), timeout)) {
+            res.status = 400;
+            set_error(res, "Неверный timeout");
+            return;
+        }
+        timeout = min(timeout, MAX_CHANGE_POLL_TIMEOUT);
+
+        vector<ChangeEvent> events;
+        auto result = feed.read(since, CHANGE_BATCH_SIZE, events);
+        if (result == ChangeFeed::ReadResult::Expired) {
+            res.status = 410;
+            res.set_header("X-Change-Seq", to_string(feed.last_seq()));
+            set_error(res, "История изменений уже не содержит события после since");
+            return;
+        }
+        if (result == ChangeFeed::ReadResult::Invalid) {
+            res.status = 400;
+            set_error(res, "since больше номера последнего изменения");
+            return;
+        }
+
+        if (sse && can_wait) {
+            auto state = make_shared<ChangeStream>(feed, since, true, chrono::steady_clock::now() + SSE_HEARTBEAT);
+            res.set_header("Cache-Control", "no-cache");
+            res.set_chunked_content_provider("text/event-stream", [state](size_t, DataSink& sink) {
+                return state->provide(sink);
+                });
+            return;
+        }
+
+        if (!events.empty() || timeout == 0 || !can_wait) {
+            if (!events.empty()) since = events.back().seq;
+            append_changes_json(res.begin_content("application/json"), events, since);
+            return;
+        }
+
+        auto state = make_shared<ChangeStream>(feed, since, false, chrono::steady_clock::now() + chrono::seconds(timeout));
+        res.set_chunked_content_provider("application/json", [state](size_t, DataSink& sink) {
+            return state->provide(sink);
+            });
+        });
+
+    // ========== POST /tasks - создать задачу (СИНХРОННО) ==========
+    svr.Post("/tasks", [&manager, &logger](const Request& req, Response& res) {
+
+        if (req.body.empty()) {
+            res.status = 400;
+            set_error(res, "Пустое тело запроса");
+            return;
+        }
+
+        try {
+            Task new_task;
+            if (!read_task_body(req, res, new_task)) return;
+
+            // СИНХРОННО создаем задачу
+            int task_id = manager.create_task(new_task);
+            new_task.id = task_id;
+
+            res.status = 201;  // Created
+            new_task.view().append_json(res.begin_content("application/json"));
+
+            // Асинхронно логируем операцию через очередь
+            log_operation(logger, "POST /tasks - Создана задача", task_id);
+        }
+        catch (const StorageError&) {
+            set_storage_error(res);
+        }
+        catch (const exception& e) {
+            res.status = 400;
+            set_error(res, "Неверный JSON формат");
+        }
+        });
+
+    // ========== POST /tasks:batch - создать несколько задач ==========
+    // Тело - массив задач, ответ - массив результатов в том же порядке.
+    // Все задачи создаются за одну блокировку на шард и один сброс журнала
+    svr.Post("/tasks:batch", [&manager, &logger](const Request& req, Response& res) {
+        JsonReader reader(req.body);
+        vector<Task> items;
+        vector<string> errors;
+        if (reader.begin_array()) {
+            while (items.size() <= MAX_BATCH_SIZE && reader.next_element()) {
+                Task task;
+                string error;
+                if (!Task::read_json(reader, task, error)) break;
+                if (error.empty() && task.title.empty()) error = "Заголовок задачи обязателен";
+                items.push_back(move(task));
+                errors.push_back(move(error));
+            }
+        }
+        if (items.size() > MAX_BATCH_SIZE) {
+            res.status = 413;
+            set_error(res, "Слишком много элементов в пакете");
+            return;
+        }
+        if (!reader.finish()) {
+            res.status = 400;
+            set_error(res, "Неверный JSON формат");
+            return;
+        }
+
+        // Ошибочные элементы не создаются, остальные уходят одним пакетом
+        vector<Task> to_create;
+        to_create.reserve(items.size());
+        for (size_t i = 0; i < items.size(); i++) {
+            if (errors[i].empty()) to_create.push_back(move(items[i]));
+        }
+        vector<TaskPtr> created;
+        try {
+            created = manager.create_tasks(to_create);
+        }
+        catch (const StorageError&) {
+            set_storage_error(res);
+            return;
+        }
+
+        pmr::string& result = res.begin_content("application/json");
+        result += "[";
+        size_t next = 0;
+        for (size_t i = 0; i < items.size(); i++) {
+            if (i > 0) result += ",";
+            if (errors[i].empty()) append_item_task(result, 201, *created[next++]);
+            else append_item_error(result, 400, errors[i]);
+        }
+        result += "]";
+
+        if (logger.enabled(LogLevel::Info)) {
+            pmr::string message("POST /tasks:batch - Создано задач: ", req.resource());
+            json_append_int(message, created.size());
+            log_operation(logger, message);
+        }
+        });
+
+    // ========== PATCH /tasks:batch - изменить несколько задач ==========
+    // Тело - массив {"id":N, "title"?, "description"?, "status"?}; меняются только
+    // переданные поля. Ответ - массив результатов: 200 с задачей, 404 или 400
+    svr.Patch("/tasks:batch", [&manager, &logger](const Request& req, Response& res) {
+        JsonReader reader(req.body);
+        vector<TaskChange> changes;
+        vector<string> errors;
+        if (reader.begin_array()) {
+            while (changes.size() <= MAX_BATCH_SIZE && reader.next_element()) {
+                TaskChange change;
+                string error;
+                if (!read_task_change(reader, change, error)) break;
+                changes.push_back(move(change));
+                errors.push_back(move(error));
+            }
+        }
+        if (changes.size() > MAX_BATCH_SIZE) {
+            res.status = 413;
+            set_error(res, "Слишком много элементов в пакете");
+            return;
+        }
+        if (!reader.finish()) {
+            res.status = 400;
+            set_error(res, "Неверный JSON формат");
+            return;
+        }
+
+        // Ошибочные элементы не применяются: id 0 не найдется ни в одном шарде
+        for (size_t i = 0; i < changes.size(); i++) {
+            if (!errors[i].empty()) changes[i].id = 0;
+        }
+        vector<TaskPtr> updated;
+        try {
+            updated = manager.apply_changes(changes);
+        }
+        catch (const StorageError&) {
+            set_storage_error(res);
+            return;
+        }
+
+        pmr::string& result = res.begin_content("application/json");
+        result += "[";
+        size_t applied = 0;
+        for (size_t i = 0; i < changes.size(); i++) {
+            if (i > 0) result += ",";
+            if (!errors[i].empty()) {
+                append_item_error(result, 400, errors[i]);
+            }
+            else if (!updated[i]) {
+                append_item_error(result, 404, "Задача не найдена");
+            }
+            else {
+                append_item_task(result, 200, *updated[i]);
+                applied++;
+            }
+        }
+        result += "]";
+
+        if (logger.enabled(LogLevel::Info)) {
+            pmr::string message("PATCH /tasks:batch - Изменено задач: ", req.resource());
+            json_append_int(message, applied);
+            log_operation(logger, message);
+        }
+        });
+
+    // ========== GET /tasks/{id} ==========
+    svr.Get("/tasks/{id:int}", [&manager, &logger](const Request& req, Response& res) {
+        int task_id = task_id_param(req);
+        log_operation(logger, "GET /tasks/{id} - Получение задачи", task_id);
+
+        TaskPtr task = manager.find_task(task_id);
+
+        if (!task) {
+            res.status = 404;
+            set_error(res, "Задача не найдена");
+            return;
+        }
+
+        // Неизменившаяся задача - 304 без сериализации
+        Etag etag = make_etag(task->version);
+        if (etag_matches(req, etag.view())) {
+            not_modified(res, etag.view());
+            return;
+        }
+
+        // JSON версии отправляется без копирования, пока ответ держит задачу
+        res.set_header("ETag", etag.view());
+        res.set_content(task, task->json(), "application/json");
+        });
+
+    // ========== PUT /tasks/{id} - обновить задачу (СИНХРОННО) ==========
+    svr.Put("/tasks/{id:int}", [&manager, &logger](const Request& req, Response& res) {
+        int task_id = task_id_param(req);
+
+        if (req.body.empty()) {
+            res.status = 400;
+            set_error(res, "Пустое тело запроса");
+            return;
+        }
+
+        try {
+            Task updated_task;
+            if (!read_task_body(req, res, updated_task)) return;
+            updated_task.id = task_id;
+
+            // СИНХРОННО обновляем задачу
+            if (manager.update_task(task_id, updated_task)) {
+                updated_task.view().append_json(res.begin_content("application/json"));
+                log_operation(logger, "PUT /tasks/{id} - Задача обновлена", task_id);
+            }
+            else {
+                res.status = 404;
+                set_error(res, "Задача не найдена");
+            }
+        }
+        catch (const StorageError&) {
+            set_storage_error(res);
+        }
+        catch (const exception& e) {
+            res.status = 400;
+            set_error(res, "Неверный JSON формат");
+        }
+        });
+
+    // ========== PATCH /tasks/{id} - обновить статус (СИНХРОННО) ==========
+    svr.Patch("/tasks/{id:int}", [&manager, &logger](const Request& req, Response& res) {
+        int task_id = task_id_param(req);
+
+        if (req.body.empty()) {
+            res.status = 400;
+            set_error(res, "Пустое тело запроса");
+            return;
+        }
+
+        try {
+            // Из тела нужен только статус, остальные поля пропускаются
+            JsonReader reader(req.body);
+            string_view key;
+            string new_status;
+            bool has_status = false;
+            if (reader.begin_object()) {
+                while (reader.next_key(key)) {
+                    if (key == "status") has_status = reader.read_string(new_status);
+                    else reader.skip_value();
+                }
+            }
+
+            if (!reader.finish()) {
+                res.status = 400;
+                set_error(res, "Неверный JSON формат");
+                return;
+            }
+            if (!has_status) {
+                res.status = 400;
+                set_error(res, "Поле 'status' обязательно");
+                return;
+            }
+            // Как и PATCH /tasks:batch, неизвестный статус не подменяется на todo
+            TaskStatus parsed_status;
+            if (!Task::parse_status(new_status, parsed_status)) {
+                res.status = 400;
+                set_error(res, "Неизвестный статус");
+                return;
+            }
+
+            // СИНХРОННО обновляем статус
+            // Отдается та версия, что установил этот запрос: повторный поиск
+            // мог бы вернуть чужое изменение или ничего после удаления
+            if (auto updated = manager.patch_task(task_id, parsed_status)) {
+                res.set_content(updated, updated->json(), "application/json");
+                if (logger.enabled(LogLevel::Info)) {
+                    pmr::string message("PATCH /tasks/{id} - Статус изменен на: ", req.resource());
+                    message += new_status;
+                    log_operation(logger, message, task_id);
+                }
+            }
+            else {
+                res.status = 404;
+                set_error(res, "Задача не найдена");
+            }
+        }
+        catch (const StorageError&) {
+            set_storage_error(res);
+        }
+        catch (const exception& e) {
+            res.status = 400;
+            set_error(res, "Неверный JSON формат");
+        }
+        });
+
+    // ========== DELETE /tasks/{id} - удалить задачу (СИНХРОННО) ==========
+    svr.Delete("/tasks/{id:int}", [&manager, &logger](const Request& req, Response& res) {
+        int task_id = task_id_param(req);
+
+        // СИНХРОННО удаляем задачу
+        try {
+            if (manager.delete_task(task_id)) {
+                res.status = 204;  // No Content
+                log_operation(logger, "DELETE /tasks/{id} - Задача удалена", task_id);
+            }
+            else {
+                res.status = 404;
+                set_error(res, "Задача не найдена");
+            }
+        }
+        catch (const StorageError&) {
+            set_storage_error(res);
+        }
+        });
+
+    // ========== GET /metrics - метрики в формате Prometheus ==========
+    // Счетчики и гистограммы задержек ведет сервер; размер очереди и число
+    // задач снимаются в момент запроса
+    svr.set_metrics_gauge("todo_message_queue_depth", "Jobs waiting in the message queue.",
+        [&job_queue]() { return (double)job_queue.pending(); });
+    svr.set_metrics_gauge("todo_tasks", "Tasks currently stored.",
+        [&manager]() { return (double)manager.size(); });
+    svr.set_metrics_gauge("todo_change_subscribers", "Clients waiting on the change feed.",
+        [&manager]() { return (double)manager.changes().subscriber_count(); });
+    svr.Get("/metrics", [&svr](const Request&, Response& res) {
+        svr.write_metrics(res.begin_content("text/plain; version=0.0.4; charset=utf-8"));
+        });
+
+    // ========== GET / - главная страница ==========
+    // Страница собирается один раз, все ответы отправляют одну и ту же строку;
+    // ее сжатая копия тоже одна на всех (кэш сжатия сервера)
+    auto index_html = make_shared<const string>(R"(
+<!DOCTYPE html>
+<html>
+<head>
+    <title>To-Do API</title>
+    <style>
+        body { font-family: Arial, sans-serif; margin: 40px; }
+        .endpoint { background: #f5f5f5; padding: 15px; margin: 10px 0; border-radius: 5px; }
+        .method { display: inline-block; padding: 5px 10px; border-radius: 3px; color: white; font-weight: bold; }
+        .get { background: #61affe; }
+        .post { background: #49cc90; }
+        .put { background: #fca130; }
+        .patch { background: #50e3c2; }
+        .delete { background: #f93e3e; }
+    </style>
+</head>
+<body>
+    <h1>📝 To-Do API Server</h1>
+    <p>REST API для управления списком задач с очередью сообщений</p>
+    
+    <div class="endpoint">
+        <span class="method get">GET</span> <strong>/tasks</strong><br>
+        Получить список всех задач<br>
+        Параметры: status=todo|in_progress|done, limit=N, cursor=id (следующий курсор - в заголовке X-Next-Cursor)
+    </div>
+    
+    <div class="endpoint">
+        <span class="method get">GET</span> <strong>/tasks/stats</strong><br>
+        Число задач всего и по каждому статусу
+    </div>
+    
+    <div class="endpoint">
+        <span class="method get">GET</span> <strong>/tasks/changes</strong><br>
+        Лента изменений задач: long-poll или Server-Sent Events (Accept: text/event-stream)<br>
+        Параметры: since=номер (начальный - в заголовке X-Change-Seq ответа GET /tasks), timeout=секунды
+    </div>
+    
+    <div class="endpoint">
+        <span class="method get">GET</span> <strong>/metrics</strong><br>
+        Метрики сервера в формате Prometheus: запросы, задержки, соединения, очередь
+    </div>
+    
+    <div class="endpoint">
+        <span class="method post">POST</span> <strong>/tasks</strong><br>
+        Создать новую задачу<br>
+        Пример: {"title": "Задача", "description": "Описание", "status": "todo"}
+    </div>
+    
+    <div class="endpoint">
+        <span class="method post">POST</span> <strong>/tasks:batch</strong><br>
+        Создать несколько задач одним запросом<br>
+        Пример: [{"title": "Первая"}, {"title": "Вторая", "status": "done"}]
+    </div>
+    
+    <div class="endpoint">
+        <span class="method patch">PATCH</span> <strong>/tasks:batch</strong><br>
+        Изменить несколько задач (только переданные поля)<br>
+        Пример: [{"id": 1, "status": "done"}, {"id": 2, "title": "Новый заголовок"}]
+    </div>
+    
+    <div class="endpoint">
+        <span class="method get">GET</span> <strong>/tasks/{id}</strong><br>
+        Получить задачу по ID
+    </div>
+    
+    <div class="endpoint">
+        <span class="method put">PUT</span> <strong>/tasks/{id}</strong><br>
+        Полностью обновить задачу
+    </div>
+    
+    <div class="endpoint">
+        <span class="method patch">PATCH</span> <strong>/tasks/{id}</strong><br>
+        Обновить статус задачи<br>
+        Пример: {"status": "in_progress"}
+    </div>
+    
+    <div class="endpoint">
+        <span class="method delete">DELETE</span> <strong>/tasks/{id}</strong><br>
+        Удалить задачу по ID
+    </div>
+    
+    <p><strong>Особенность:</strong> Все операции пишутся в асинхронный JSON-лог</p>
+</body>
+</html>
+        )");
+    svr.Get("/", [index_html](const Request&, Response& res) {
+        res.set_content(index_html, "text/html");
+        });
+}
\ No newline at end of file
@@ -0,0 +1,26 @@
+#pragma once
+#ifndef ROUTES_H
+#define ROUTES_H
+
+#include "handler.h"
+#include "queue.h"
+#include "logger.h"
+#include "httplib.h"
+#include <charconv>
+#include <string_view>
+
+// Разбирает неотрицательное целое целиком, без пробелов и знака
+template <typename Int>
+bool parse_int(std::string_view value, Int& result) {
+    if (value.empty() || value[0] == '-' || value[0] == '+') return false;
+    auto [end, ec] = std::from_chars(value.data(), value.data() + value.size(), result);
+    return ec == std::errc() && end == value.data() + value.size();
+}
+
+// Регистрирует обработчики API задач, /metrics и страницу документации.
+// Обработчики не зависят от сокетов: сервер можно вызывать в процессе через
+// Server::dispatch или Server::process_session (тесты, бенчмарки, встраивание).
+// manager, logger и job_queue должны жить дольше сервера
+void register_routes(httplib::Server& svr, TaskManager& manager, Logger& logger, MessageQueue& job_queue);
+
+#endif
\ No newline at end of file
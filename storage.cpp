@@ -0,0 +1,564 @@
+#include "storage.h"
+#include <filesystem>
+#include <iostream>
+#include <fstream>
+#include <cstring>
+#include <vector>
+#include <algorithm>
+
+#ifdef _WIN32
+#include <io.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+namespace fs = std::filesystem;
+
+namespace {
+
+    // Формат записи: [u32 длина данных][u32 crc32 данных][данные].
+    // Данные: u8 тип, i32 id, для PUT еще u8 статус и две строки (u32 длина + байты).
+    // Числа пишутся в порядке байт машины (little-endian на x86/ARM).
+    const uint8_t RECORD_PUT = 1;
+    const uint8_t RECORD_DELETE = 2;
+    const size_t RECORD_HEADER = 8;
+
+    // Заголовок снимка: "TSNP", u32 версия, u64 сегмент WAL, i32 next_id, u64 число задач
+    const char SNAPSHOT_MAGIC[4] = { 'T', 'S', 'N', 'P' };
+    const uint32_t SNAPSHOT_VERSION = 1;
+    const size_t SNAPSHOT_HEADER = 4 + 4 + 8 + 4 + 8;
+
+    uint32_t crc32(const char* data, size_t size) {
+        static const auto table = [] {
+            std::vector<uint32_t> t(256);
+            for (uint32_t i = 0; i < 256; i++) {
+                uint32_t c = i;
+                for (int k = 0; k < 8; k++) c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+                t[i] = c;
+            }
+            return t;
+        }();
+
+        uint32_t crc = 0xFFFFFFFFu;
+        for (size_t i = 0; i < size; i++) {
+            crc = table[(crc ^ (uint8_t)data[i]) & 0xFF] ^ (crc >> 8);
+        }
+        return crc ^ 0xFFFFFFFFu;
+    }
+
+    template <typename T>
+    void put(std::string& out, T value) {
+        out.append(reinterpret_cast<const char*>(&value), sizeof(value));
+    }
+
+    template <typename T>
+    bool get(const char*& p, const char* end, T& value) {
+        if ((size_t)(end - p) < sizeof(T)) return false;
+        std::memcpy(&value, p, sizeof(T));
+        p += sizeof(T);
+        return true;
+    }
+
+    bool get_string(const char*& p, const char* end, std::string& value) {
+        uint32_t size;
+        if (!get(p, end, size) || (size_t)(end - p) < size) return false;
+        value.assign(p, size);
+        p += size;
+        return true;
+    }
+
+    void encode(std::string& out, uint8_t type, const TaskView& task) {
+        size_t start = out.size();
+        out.resize(start + RECORD_HEADER);
+
+        put(out, type);
+        put(out, (int32_t)task.id);
+        if (type == RECORD_PUT) {
+            put(out, (uint8_t)task.status);
+            put(out, (uint32_t)task.title.size());
+            out += task.title;
+            put(out, (uint32_t)task.description.size());
+            out += task.description;
+        }
+
+        uint32_t size = (uint32_t)(out.size() - start - RECORD_HEADER);
+        uint32_t crc = crc32(out.data() + start + RECORD_HEADER, size);
+        std::memcpy(&out[start], &size, 4);
+        std::memcpy(&out[start + 4], &crc, 4);
+    }
+
+    // Проигрывает записи подряд, пока они целы. Возвращает длину корректной части
+    size_t replay(const char* data, size_t size, size_t max_records,
+        const TaskStorage::TaskCallback& on_put, const std::function<void(int)>& on_delete, int& max_id) {
+        const char* p = data;
+        const char* end = data + size;
+        Task task;
+
+        for (size_t n = 0; n < max_records; n++) {
+            const char* record = p;
+            uint32_t length, crc;
+            if (!get(p, end, length) || !get(p, end, crc) || (size_t)(end - p) < length) return record - data;
+            if (crc32(p, length) != crc) return record - data;
+
+            const char* body_end = p + length;
+            uint8_t type, status;
+            int32_t id;
+            if (!get(p, body_end, type) || !get(p, body_end, id)) return record - data;
+
+            if (type == RECORD_PUT) {
+                if (!get(p, body_end, status) || status > (uint8_t)TaskStatus::DONE ||
+                    !get_string(p, body_end, task.title) || !get_string(p, body_end, task.description)) {
+                    return record - data;
+                }
+                task.id = id;
+                task.status = (TaskStatus)status;
+                on_put(task.view());
+            }
+            else if (type == RECORD_DELETE) {
+                on_delete(id);
+            }
+            else {
+                return record - data;
+            }
+
+            max_id = std::max(max_id, (int)id);
+            p = body_end;
+            if (p == end) break;
+        }
+        return p - data;
+    }
+
+#ifdef _WIN32
+    int open_append(const std::string& path) {
+        return _open(path.c_str(), _O_WRONLY | _O_CREAT | _O_APPEND | _O_BINARY, _S_IREAD | _S_IWRITE);
+    }
+
+    int open_truncate(const std::string& path) {
+        return _open(path.c_str(), _O_WRONLY | _O_CREAT | _O_TRUNC | _O_BINARY, _S_IREAD | _S_IWRITE);
+    }
+
+    bool write_all(int fd, const char* data, size_t size) {
+        while (size > 0) {
+            int n = _write(fd, data, (unsigned int)std::min<size_t>(size, 1 << 30));
+            if (n <= 0) return false;
+            data += n;
+            size -= n;
+        }
+        return true;
+    }
+
+    bool sync_file(int fd) { return _commit(fd) == 0; }
+    // На Windows каталог не открыть как файл, изменения имен фиксирует журнал NTFS
+    bool sync_directory(const std::string&) { return true; }
+    void close_file(int fd) { _close(fd); }
+#else
+    int open_append(const std::string& path) {
+        return open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    }
+
+    int open_truncate(const std::string& path) {
+        return open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    }
+
+    bool write_all(int fd, const char* data, size_t size) {
+        while (size > 0) {
+            ssize_t n = write(fd, data, size);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) return false;
+            data += n;
+            size -= n;
+        }
+        return true;
+    }
+
+    bool sync_file(int fd) {
+#ifdef __linux__
+        return fdatasync(fd) == 0;
+#else
+        return fsync(fd) == 0;
+#endif
+    }
+
+    // Создание, переименование и удаление файла переживут сбой питания,
+    // только когда сброшен сам каталог
+    bool sync_directory(const std::string& path) {
+        int fd = open(path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (fd < 0) return false;
+        bool ok = fsync(fd) == 0;
+        close(fd);
+        return ok;
+    }
+
+    void close_file(int fd) { close(fd); }
+#endif
+
+    // Файл, отображенный в память только для чтения (на Windows читается целиком)
+    class MappedFile {
+    public:
+        explicit MappedFile(const std::string& path) {
+#ifdef _WIN32
+            std::ifstream in(path, std::ios::binary);
+            buffer.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+            ptr = buffer.data();
+            length = buffer.size();
+#else
+            int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+            if (fd < 0) return;
+            struct stat st;
+            if (fstat(fd, &st) == 0 && st.st_size > 0) {
+                void* p = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+                if (p != MAP_FAILED) {
+                    madvise(p, st.st_size, MADV_SEQUENTIAL);
+                    ptr = static_cast<const char*>(p);
+                    length = st.st_size;
+                }
+            }
+            close(fd);
+#endif
+        }
+
+        ~MappedFile() {
+#ifndef _WIN32
+            if (ptr) munmap(const_cast<char*>(ptr), length);
+#endif
+        }
+
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+
+        const char* data() const { return ptr; }
+        size_t size() const { return length; }
+
+    private:
+        const char* ptr = nullptr;
+        size_t length = 0;
+#ifdef _WIN32
+        std::vector<char> buffer;
+#endif
+    };
+
+    // Номер сегмента из имени wal-<N>.log, 0 если имя не подходит
+    uint64_t segment_gen(const fs::path& path) {
+        std::string name = path.filename().string();
+        if (name.size() < 9 || name.compare(0, 4, "wal-") != 0 ||
+            name.compare(name.size() - 4, 4, ".log") != 0) {
+            return 0;
+        }
+        try {
+            return std::stoull(name.substr(4, name.size() - 8));
+        }
+        catch (const std::exception&) {
+            return 0;
+        }
+    }
+
+    std::vector<std::pair<uint64_t, fs::path>> list_segments(const std::string& directory) {
+        std::vector<std::pair<uint64_t, fs::path>> segments;
+        std::error_code ec;
+        for (const auto& entry : fs::directory_iterator(directory, ec)) {
+            uint64_t gen = segment_gen(entry.path());
+            if (gen > 0) segments.emplace_back(gen, entry.path());
+        }
+        std::sort(segments.begin(), segments.end());
+        return segments;
+    }
+
+} // namespace
+
+TaskStorage::TaskStorage(StorageOptions opts) : options(std::move(opts)) {}
+
+TaskStorage::~TaskStorage() {
+    stop();
+}
+
+std::string TaskStorage::segment_path(uint64_t gen) const {
+    char name[32];
+    snprintf(name, sizeof(name), "wal-%016llu.log", (unsigned long long)gen);
+    return (fs::path(options.directory) / name).string();
+}
+
+bool TaskStorage::recover(const TaskCallback& on_put, const std::function<void(int)>& on_delete, int& next_id) {
+    std::error_code ec;
+    fs::create_directories(options.directory, ec);
+    if (ec) {
+        std::cerr << "Не удалось создать каталог " << options.directory << ": " << ec.message() << std::endl;
+        return false;
+    }
+
+    int max_id = 0;
+    uint64_t start_gen = 1;
+    next_id = 1;
+
+    // Снимок отображается в память и разбирается без промежуточного чтения
+    std::string snapshot_path = (fs::path(options.directory) / "snapshot.bin").string();
+    if (fs::exists(snapshot_path)) {
+        MappedFile snapshot(snapshot_path);
+        const char* p = snapshot.data();
+        const char* end = p + snapshot.size();
+        uint32_t version = 0;
+        uint64_t gen = 0, count = 0;
+        int32_t snapshot_next_id = 0;
+
+        if (snapshot.size() < SNAPSHOT_HEADER || std::memcmp(p, SNAPSHOT_MAGIC, 4) != 0) {
+            std::cerr << "Поврежден снимок " << snapshot_path << std::endl;
+            return false;
+        }
+        p += 4;
+        get(p, end, version);
+        get(p, end, gen);
+        get(p, end, snapshot_next_id);
+        get(p, end, count);
+        if (version != SNAPSHOT_VERSION) {
+            std::cerr << "Неизвестная версия снимка " << version << std::endl;
+            return false;
+        }
+
+        size_t size = end - p;
+        if (count > 0 && replay(p, size, count, on_put, on_delete, max_id) != size) {
+            std::cerr << "Поврежден снимок " << snapshot_path << std::endl;
+            return false;
+        }
+        start_gen = gen;
+        next_id = snapshot_next_id;
+    }
+
+    // Проигрываем сегменты журнала, начиная с указанного в снимке
+    wal_gen = start_gen - 1;
+    for (const auto& [gen, path] : list_segments(options.directory)) {
+        if (gen < start_gen) {
+            fs::remove(path, ec);
+            continue;
+        }
+
+        size_t valid, size;
+        {
+            MappedFile segment(path.string());
+            size = segment.size();
+            valid = replay(segment.data(), size, SIZE_MAX, on_put, on_delete, max_id);
+        }
+        if (valid < size) {
+            // Хвост, недописанный при сбое, отбрасываем
+            std::cerr << "WAL " << path.filename().string() << ": отброшено "
+                << (size - valid) << " байт поврежденного хвоста" << std::endl;
+            fs::resize_file(path, valid, ec);
+        }
+        wal_gen = gen;
+    }
+
+    next_id = std::max(next_id, max_id + 1);
+    return true;
+}
+
+bool TaskStorage::open_segment(uint64_t gen) {
+    int fd = open_append(segment_path(gen));
+    if (fd >= 0 && !sync_directory(options.directory)) {
+        // Без сброса каталога сегмент может пропасть после сбоя вместе с записями
+        close_file(fd);
+        fd = -1;
+    }
+    if (fd < 0) {
+        std::cerr << "Не удалось открыть " << segment_path(gen) << std::endl;
+        return false;
+    }
+    wal_fd = fd;
+    wal_gen = gen;
+    return true;
+}
+
+bool TaskStorage::start(SnapshotSource snapshot_source) {
+    source = std::move(snapshot_source);
+    if (!open_segment(wal_gen + 1)) return false;
+
+    snapshot_running = true;
+    writer = std::thread([this]() { writer_loop(); });
+    snapshotter = std::thread([this]() { snapshot_loop(); });
+    return true;
+}
+
+uint64_t TaskStorage::append_put(const TaskView& task) {
+    std::lock_guard<std::mutex> lock(mtx);
+    encode(pending, RECORD_PUT, task);
+    segment_records++;
+    if (options.durability == Durability::PerRequest) writer_cv.notify_one();
+    return ++last_lsn;
+}
+
+uint64_t TaskStorage::append_delete(int id) {
+    TaskView task;
+    task.id = id;
+
+    std::lock_guard<std::mutex> lock(mtx);
+    encode(pending, RECORD_DELETE, task);
+    segment_records++;
+    if (options.durability == Durability::PerRequest) writer_cv.notify_one();
+    return ++last_lsn;
+}
+
+bool TaskStorage::wait_durable(uint64_t lsn) {
+    if (options.durability != Durability::PerRequest) return !failed.load(std::memory_order_relaxed);
+    std::unique_lock<std::mutex> lock(mtx);
+    durable_cv.wait(lock, [this, lsn] { return durable_lsn >= lsn || failed.load(std::memory_order_relaxed); });
+    return durable_lsn >= lsn;
+}
+
+// Групповая запись: все записи, накопленные за время предыдущего fsync,
+// уходят на диск одним write и одним fsync
+void TaskStorage::writer_loop() {
+    std::string batch;
+    std::unique_lock<std::mutex> lock(mtx);
+
+    for (;;) {
+        if (options.durability == Durability::PerRequest) {
+            writer_cv.wait(lock, [this] { return stopping || !pending.empty(); });
+        }
+        else {
+            writer_cv.wait_for(lock, options.batch_interval, [this] { return stopping; });
+        }
+
+        if (pending.empty()) {
+            if (stopping) break;
+            continue;
+        }
+
+        batch.swap(pending);
+        uint64_t upto = last_lsn;
+        bool rotate = segment_records >= options.snapshot_threshold;
+        if (rotate) segment_records = 0;
+        lock.unlock();
+
+        // После ошибки журнал больше не пишется: записи за недописанным
+        // хвостом все равно не проиграются при восстановлении
+        bool ok = !failed.load(std::memory_order_relaxed) && write_all(wal_fd, batch.data(), batch.size());
+        if (ok && (options.durability != Durability::Async || rotate)) ok = sync_file(wal_fd);
+        batch.clear();
+
+        // Сегмент заполнен: начинаем новый и просим снимок, после которого
+        // старые сегменты можно удалить
+        if (ok && rotate) {
+            // Старый сегмент закрывается только после открытия нового: если
+            // открыть не удалось, записи дописываются в старый до следующей попытки
+            int old_fd = wal_fd;
+            if (open_segment(wal_gen + 1)) {
+                close_file(old_fd);
+                std::lock_guard<std::mutex> snapshot_lock(snapshot_mtx);
+                snapshot_requested = wal_gen;
+                snapshot_cv.notify_one();
+            }
+        }
+
+        lock.lock();
+        if (ok) durable_lsn = upto;
+        else if (!failed.exchange(true)) std::cerr << "Ошибка записи WAL, изменения больше не сохраняются" << std::endl;
+        durable_cv.notify_all();
+    }
+
+    if (!failed) durable_lsn = last_lsn;
+    durable_cv.notify_all();
+}
+
+void TaskStorage::snapshot_loop() {
+    std::unique_lock<std::mutex> lock(snapshot_mtx);
+    for (;;) {
+        snapshot_cv.wait(lock, [this] { return snapshot_requested > 0 || !snapshot_running; });
+        if (snapshot_requested == 0) break;
+
+        uint64_t gen = snapshot_requested;
+        snapshot_requested = 0;
+        lock.unlock();
+
+        if (write_snapshot(gen)) {
+            std::error_code ec;
+            for (const auto& [old_gen, path] : list_segments(options.directory)) {
+                if (old_gen < gen) fs::remove(path, ec);
+            }
+        }
+
+        lock.lock();
+    }
+}
+
+// Снимок пишется во временный файл и атомарно переименовывается.
+// true - снимок надежно на диске, сегменты до gen можно удалять
+bool TaskStorage::write_snapshot(uint64_t gen) {
+    std::string tmp_path = (fs::path(options.directory) / "snapshot.tmp").string();
+    std::string final_path = (fs::path(options.directory) / "snapshot.bin").string();
+
+    int fd = open_truncate(tmp_path);
+    if (fd < 0) return false;
+
+    std::string buffer;
+    buffer.append(SNAPSHOT_MAGIC, 4);
+    put(buffer, SNAPSHOT_VERSION);
+    put(buffer, gen);
+    put(buffer, (int32_t)0);   // next_id, заполняется после обхода
+    put(buffer, (uint64_t)0);  // число задач
+
+    bool ok = write_all(fd, buffer.data(), buffer.size());
+    buffer.clear();
+
+    uint64_t count = 0;
+    int32_t next_id = source([&](const TaskView& task) {
+        encode(buffer, RECORD_PUT, task);
+        count++;
+        if (buffer.size() >= (1 << 20)) {
+            ok = ok && write_all(fd, buffer.data(), buffer.size());
+            buffer.clear();
+        }
+        });
+    ok = ok && write_all(fd, buffer.data(), buffer.size());
+    close_file(fd);
+
+    // Дописываем next_id и число задач в заголовок
+    if (ok) {
+        std::fstream header(tmp_path, std::ios::binary | std::ios::in | std::ios::out);
+        header.seekp(4 + 4 + 8);
+        header.write(reinterpret_cast<const char*>(&next_id), sizeof(next_id));
+        header.write(reinterpret_cast<const char*>(&count), sizeof(count));
+        ok = (bool)header;
+    }
+    if (ok) {
+        int sync_fd = open_append(tmp_path);
+        ok = sync_fd >= 0 && sync_file(sync_fd);
+        if (sync_fd >= 0) close_file(sync_fd);
+    }
+
+    // Пока переименование не сброшено вместе с каталогом, старые сегменты
+    // удалять нельзя: после сбоя удаление могло бы сохраниться, а снимок нет
+    std::error_code ec;
+    if (ok) fs::rename(tmp_path, final_path, ec);
+    if (ok && !ec) ok = sync_directory(options.directory);
+    if (!ok || ec) {
+        std::cerr << "Не удалось записать снимок " << final_path << std::endl;
+        fs::remove(tmp_path, ec);
+        return false;
+    }
+    return true;
+}
+
+void TaskStorage::stop() {
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        if (stopping) return;
+        stopping = true;
+    }
+    writer_cv.notify_all();
+    if (writer.joinable()) writer.join();
+
+    {
+        std::lock_guard<std::mutex> lock(snapshot_mtx);
+        snapshot_running = false;
+    }
+    snapshot_cv.notify_all();
+    if (snapshotter.joinable()) snapshotter.join();
+
+    if (wal_fd >= 0) {
+        sync_file(wal_fd);
+        close_file(wal_fd);
+        wal_fd = -1;
+    }
+}
\ No newline at end of file
@@ -0,0 +1,103 @@
+#pragma once
+#ifndef STORAGE_H
+#define STORAGE_H
+
+#include "task.h"
+#include <string>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <atomic>
+#include <stdexcept>
+#include <cstdint>
+
+// Когда запись считается сохраненной
+enum class Durability {
+    PerRequest,  // ответ уходит только после fsync (один fsync на группу параллельных запросов)
+    Batched,     // fsync раз в batch_interval, при сбое теряется не больше одного интервала
+    Async        // запись отдается ОС без fsync
+};
+
+struct StorageOptions {
+    std::string directory = "data";
+    Durability durability = Durability::Batched;
+    std::chrono::milliseconds batch_interval{ 10 };
+    size_t snapshot_threshold = 100000;  // записей в сегменте WAL до нового снимка
+};
+
+// Журнал не сохранил изменение (ошибка записи или fsync)
+class StorageError : public std::runtime_error {
+public:
+    using std::runtime_error::runtime_error;
+};
+
+// Журнал изменений (WAL) и периодические снимки задач на диске.
+// Журнал разбит на сегменты wal-<N>.log; снимок snapshot.bin хранит все задачи
+// и номер сегмента, с которого нужно продолжать проигрывание.
+class TaskStorage {
+public:
+    using TaskCallback = std::function<void(const TaskView&)>;
+    // Перебирает все задачи через emit и возвращает следующий свободный id
+    using SnapshotSource = std::function<int(const TaskCallback& emit)>;
+
+    explicit TaskStorage(StorageOptions options);
+    ~TaskStorage();
+
+    TaskStorage(const TaskStorage&) = delete;
+    TaskStorage& operator=(const TaskStorage&) = delete;
+
+    // Загружает снимок и проигрывает хвост журнала. Вызывается до start()
+    bool recover(const TaskCallback& on_put, const std::function<void(int)>& on_delete, int& next_id);
+
+    // Открывает новый сегмент и запускает фоновые потоки записи и снимков
+    bool start(SnapshotSource source);
+
+    // Добавляют запись в журнал и возвращают ее номер (LSN).
+    // Вызываются под блокировкой шарда, чтобы порядок записей совпадал с порядком изменений
+    uint64_t append_put(const TaskView& task);
+    uint64_t append_delete(int id);
+
+    // Для Durability::PerRequest ждет fsync записи с номером lsn.
+    // false - журнал не смог ее сохранить. Ошибка записи или fsync необратима:
+    // после нее не сохраняется ни одна запись, в любом режиме
+    bool wait_durable(uint64_t lsn);
+
+    // Сбрасывает накопленное на диск и останавливает потоки
+    void stop();
+
+private:
+    void writer_loop();
+    void snapshot_loop();
+    bool open_segment(uint64_t gen);
+    bool write_snapshot(uint64_t gen);
+    std::string segment_path(uint64_t gen) const;
+
+    StorageOptions options;
+    SnapshotSource source;
+
+    std::mutex mtx;
+    std::condition_variable writer_cv;
+    std::condition_variable durable_cv;
+    std::string pending;
+    uint64_t last_lsn = 0;
+    uint64_t durable_lsn = 0;
+    size_t segment_records = 0;
+    bool stopping = false;
+    // Меняется под mtx, читается и без него
+    std::atomic<bool> failed{ false };
+
+    int wal_fd = -1;
+    uint64_t wal_gen = 0;
+
+    std::mutex snapshot_mtx;
+    std::condition_variable snapshot_cv;
+    uint64_t snapshot_requested = 0;  // номер сегмента для следующего снимка
+    bool snapshot_running = false;
+
+    std::thread writer;
+    std::thread snapshotter;
+};
+
+#endif
\ No newline at end of file
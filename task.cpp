@@ -1,68 +1,99 @@
 #include "task.h"
-#include <sstream>
-#include <iostream>
+#include "json_codec.h"
+#include <limits>
+#include <stdexcept>
 
 std::string Task::to_json() const {
-    std::ostringstream oss;
-    oss << "{";
-    oss << "\"id\":" << id << ",";
-    oss << "\"title\":\"" << title << "\",";
-    oss << "\"description\":\"" << description << "\",";
-    oss << "\"status\":\"" << status_to_string(status) << "\"";
-    oss << "}";
-    return oss.str();
+    std::string out;
+    append_json(out);
+    return out;
 }
 
-Task Task::from_json(const std::string& json_str) {
-    Task task;
+void Task::append_json(std::string& out) const {
+    view().append_json(out);
+}
 
-    //   JSON
-    size_t pos = 0;
+namespace {
 
-    //  id
-    pos = json_str.find("\"id\":");
-    if (pos != std::string::npos) {
-        size_t start = json_str.find_first_of("0123456789", pos);
-        if (start != std::string::npos) {
-            size_t end = json_str.find_first_not_of("0123456789", start);
-            task.id = std::stoi(json_str.substr(start, end - start));
+    template <typename String>
+    void append_task_json(String& out, const TaskView& task, TaskJsonFields* fields = nullptr) {
+        out += "{\"id\":";
+        json_append_int(out, task.id);
+        out += ",\"title\":";
+        size_t title_start = out.size();
+        json_append_string(out, task.title);
+        size_t title_end = out.size();
+        out += ",\"description\":";
+        size_t description_start = out.size();
+        json_append_string(out, task.description);
+        if (fields) {
+            // Кавычки вокруг значения в поля не входят
+            fields->title_pos = title_start + 1;
+            fields->title_size = title_end - title_start - 2;
+            fields->description_pos = description_start + 1;
+            fields->description_size = out.size() - description_start - 2;
         }
+        out += ",\"status\":\"";
+        out += Task::status_to_string(task.status);
+        out += "\"}";
     }
 
-    //  title
-    pos = json_str.find("\"title\":\"");
-    if (pos != std::string::npos) {
-        size_t start = pos + 9; //  "\"title\":\""
-        size_t end = json_str.find("\"", start);
-        if (end != std::string::npos) {
-            task.title = json_str.substr(start, end - start);
-        }
-    }
+} // namespace
 
-    //  description
-    pos = json_str.find("\"description\":\"");
-    if (pos != std::string::npos) {
-        size_t start = pos + 15; //  "\"description\":\""
-        size_t end = json_str.find("\"", start);
-        if (end != std::string::npos) {
-            task.description = json_str.substr(start, end - start);
-        }
-    }
+void TaskView::append_json(std::string& out) const {
+    append_task_json(out, *this);
+}
 
-    //  status
-    pos = json_str.find("\"status\":\"");
-    if (pos != std::string::npos) {
-        size_t start = pos + 10; //  "\"status\":\""
-        size_t end = json_str.find("\"", start);
-        if (end != std::string::npos) {
-            std::string status_str = json_str.substr(start, end - start);
-            task.status = string_to_status(status_str);
-        }
-    }
+void TaskView::append_json(std::pmr::string& out) const {
+    append_task_json(out, *this);
+}
 
+void TaskView::append_json(std::string& out, TaskJsonFields& fields) const {
+    append_task_json(out, *this, &fields);
+}
+
+Task Task::from_json(std::string_view json_str) {
+    Task task;
+    std::string error;
+    JsonReader reader(json_str);
+    if (!read_json(reader, task, error) || !reader.finish()) throw std::invalid_argument("invalid task JSON");
+    if (!error.empty()) throw std::invalid_argument("invalid task status");
     return task;
 }
 
+bool Task::read_json(JsonReader& reader, Task& task, std::string& error) {
+    std::string_view key;
+    std::string status_str;
+
+    // Один проход по полям объекта, незнакомые поля пропускаются
+    if (reader.begin_object()) {
+        while (reader.next_key(key)) {
+            if (key == "id") {
+                long long id = 0;
+                if (reader.read_int(id)) {
+                    if (id < 0 || id > std::numeric_limits<int>::max()) return false;
+                    task.id = (int)id;
+                }
+            }
+            else if (key == "title") {
+                reader.read_string(task.title);
+            }
+            else if (key == "description") {
+                reader.read_string(task.description);
+            }
+            else if (key == "status") {
+                if (reader.read_string(status_str) && !parse_status(status_str, task.status)) {
+                    error = "Неизвестный статус";
+                }
+            }
+            else {
+                reader.skip_value();
+            }
+        }
+    }
+    return reader.ok();
+}
+
 std::string Task::status_to_string(TaskStatus s) {
     switch (s) {
     case TaskStatus::TODO: return "todo";
@@ -71,6 +102,14 @@ std::string Task::status_to_string(TaskStatus s) {
     default: return "todo";
     }
 }
+bool Task::parse_status(std::string_view s, TaskStatus& status) {
+    if (s == "todo") status = TaskStatus::TODO;
+    else if (s == "in_progress") status = TaskStatus::IN_PROGRESS;
+    else if (s == "done") status = TaskStatus::DONE;
+    else return false;
+    return true;
+}
+
 TaskStatus Task::string_to_status(const std::string& s) {
     if (s == "in_progress") return TaskStatus::IN_PROGRESS;
     if (s == "done") return TaskStatus::DONE;
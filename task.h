@@ -3,19 +3,56 @@
 #define TASK_H
 
 #include <string>
+#include <string_view>
+#include <memory_resource>
+
+class JsonReader;
 
 enum class TaskStatus { TODO, IN_PROGRESS, DONE };
 
+// Где в JSON задачи лежат значения title и description (без кавычек)
+struct TaskJsonFields {
+    size_t title_pos = 0;
+    size_t title_size = 0;
+    size_t description_pos = 0;
+    size_t description_size = 0;
+};
+
+// Задача без владения строками: сериализация и запись в журнал без копий
+struct TaskView {
+    int id = 0;
+    std::string_view title;
+    std::string_view description;
+    TaskStatus status = TaskStatus::TODO;
+
+    void append_json(std::string& out) const;
+    void append_json(std::pmr::string& out) const;
+    // То же, и сообщает положение строковых полей в out
+    void append_json(std::string& out, TaskJsonFields& fields) const;
+};
+
 struct Task {
     int id = 0;
     std::string title;
     std::string description;
     TaskStatus status = TaskStatus::TODO;
 
+    TaskView view() const { return TaskView{ id, title, description, status }; }
     std::string to_json() const;
-    static Task from_json(const std::string& json_str);
+    // Дописывает JSON задачи в конец out, чтобы списки собирались в один буфер
+    void append_json(std::string& out) const;
+    // Бросает std::invalid_argument, если json_str - не корректный JSON-объект
+    // или в нем неизвестный статус
+    static Task from_json(std::string_view json_str);
+    // Читает один JSON-объект задачи из reader (например, элемент массива).
+    // false - объект некорректен; если сам JSON верен, но значение поля
+    // недопустимо (неизвестный статус), объект дочитывается, а описание
+    // ошибки возвращается в error
+    static bool read_json(JsonReader& reader, Task& task, std::string& error);
     static std::string status_to_string(TaskStatus s);
-    static TaskStatus string_to_status(const std::string& s);  //  
+    static TaskStatus string_to_status(const std::string& s);
+    // В отличие от string_to_status не подменяет неизвестное значение на todo
+    static bool parse_status(std::string_view s, TaskStatus& status);  // НОВЫЙ МЕТОД
 };
 
 #endif
\ No newline at end of file